@@ -0,0 +1,141 @@
+/**
+ * Linux XDP Benchmark - measures how many packets per second EtherSia can receive on Linux
+ *
+ * A second EtherSia instance, using a raw socket on the other end of a veth
+ * pair, sends bursts of UDP packets to the instance being measured, which
+ * counts them using a UDPSocket. Run it once with each backend to compare them.
+ *
+ * Create the veth pair first:
+ *
+ *     sudo ip link add veth0 type veth peer name veth1
+ *     sudo ip link set veth0 up
+ *     sudo ip link set veth1 up
+ *
+ * Type `make` in the LinuxXDPBenchmark directory to build this example.
+ * Then type `sudo ./LinuxXDPBenchmark xdp` or `sudo ./LinuxXDPBenchmark socket`.
+ *
+ * @file
+ */
+
+#include <EtherSia.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+/** Number of seconds to run the benchmark for */
+const double BENCHMARK_SECONDS = 5.0;
+
+/** Number of packets to send before draining the receiver */
+const int BURST_SIZE = 32;
+
+/** UDP port number to send the packets to */
+const uint16_t BENCHMARK_PORT = 9000;
+
+
+/**
+ * Get the time from a monotonic clock
+ *
+ * @return the number of seconds since an arbitrary point
+ */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/**
+ * Receive as many packets as possible for BENCHMARK_SECONDS
+ *
+ * @param receiver the EtherSia instance to measure, which has not been started yet
+ * @return 0 if successful
+ */
+template <class Driver> int benchmark(Driver &receiver)
+{
+    MACAddress receiverMac("5e:73:f9:8a:cf:b0");
+    MACAddress senderMac("5e:73:f9:8a:cf:b1");
+    EtherSia_LinuxSocket sender("veth1");
+    sender.enableSendBatching();
+
+    receiver.disableAutoconfiguration();
+    sender.disableAutoconfiguration();
+    if (receiver.begin(receiverMac) == false || sender.begin(senderMac) == false) {
+        Serial.println("Failed to configure Ethernet");
+        return 1;
+    }
+
+    UDPSocket listen(receiver, BENCHMARK_PORT);
+    UDPSocket udp(sender);
+    udp.setRemoteAddress(receiver.linkLocalAddress(), BENCHMARK_PORT);
+
+    /* Let the two instances find each other with Neighbour Discovery */
+    double start = now();
+    while (sender.lookupNeighbour(receiver.linkLocalAddress()) == NULL) {
+        receiver.receivePacket();
+        sender.flushSendQueue();
+        sender.receivePacket();
+        if (now() - start > 5.0) {
+            Serial.println("Neighbour Discovery failed");
+            return 1;
+        }
+    }
+
+    unsigned long sent = 0;
+    unsigned long received = 0;
+    start = now();
+    while (now() - start < BENCHMARK_SECONDS) {
+        for (int i = 0; i < BURST_SIZE; i++) {
+            udp.send("EtherSia benchmark packet");
+            sent++;
+        }
+        sender.flushSendQueue();
+
+        while (receiver.waitForPacket(0)) {
+            receiver.receivePacket();
+            if (listen.havePacket()) {
+                received++;
+            }
+        }
+    }
+    double elapsed = now() - start;
+
+    /* Count any packets that were still on their way */
+    while (receiver.waitForPacket(100)) {
+        receiver.receivePacket();
+        if (listen.havePacket()) {
+            received++;
+        }
+    }
+
+    printf("Sent:      %lu packets\n", sent);
+    printf("Received:  %lu packets\n", received);
+    printf("Rate:      %.0f packets/second\n", received / elapsed);
+
+    receiver.end();
+    sender.end();
+
+    return 0;
+}
+
+/**
+ * Main function in Linux XDP Benchmark example
+ *
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
+ * @return 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    Serial.println("[EtherSia LinuxXDPBenchmark]");
+
+    /* The backend is selected by choosing which driver to construct */
+    if (argc > 1 && strcmp(argv[1], "socket") == 0) {
+        Serial.println("Backend: PF_PACKET socket");
+        EtherSia_LinuxSocket receiver("veth0");
+        return benchmark(receiver);
+    } else {
+        Serial.println("Backend: AF_XDP");
+        EtherSia_LinuxXDP receiver("veth0");
+        return benchmark(receiver);
+    }
+}
@@ -0,0 +1,186 @@
+/**
+ * Virtual Switch Simulation - runs a subnet of EtherSia nodes inside one Linux process
+ *
+ * Each node runs on its own thread, connected to a VirtualSwitch. Node 0 is
+ * a UDP echo server, and every other node uses Neighbour Discovery to find
+ * it, sends it a packet and waits for the reply. At the end, the number of
+ * successful nodes and the switch statistics are printed.
+ *
+ * No root access or network interface is needed.
+ *
+ * Type `make` in the VirtualSwitchSimulation directory to build this example.
+ * Then type `./VirtualSwitchSimulation 500` to simulate 500 nodes.
+ *
+ * @file
+ */
+
+#include <EtherSia.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+/** UDP port number of the echo server */
+const uint16_t ECHO_PORT = 7;
+
+/** How long each client waits for a reply (in seconds) */
+const double REPLY_TIMEOUT = 5.0;
+
+/** The switch that all the nodes are connected to */
+VirtualSwitch vswitch;
+
+/** Set when all the clients have finished, to stop the server */
+volatile boolean finished = false;
+
+/** Number of clients that got a reply */
+volatile int successes = 0;
+
+/** Mutex protecting successes */
+pthread_mutex_t successLock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/**
+ * Get the time from a monotonic clock
+ *
+ * @return the number of seconds since an arbitrary point
+ */
+static double now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+/**
+ * Give each node a different MAC and IPv6 address
+ *
+ * @param node the node number
+ * @param mac set to the MAC address of the node
+ * @param address set to the IPv6 address of the node
+ */
+static void nodeAddresses(int node, MACAddress &mac, IPv6Address &address)
+{
+    char str[40];
+    snprintf(str, sizeof(str), "02:00:00:00:%02x:%02x", (node >> 8) & 0xff, node & 0xff);
+    mac = MACAddress(str);
+    snprintf(str, sizeof(str), "2001:db8::%x", node + 1);
+    address.fromString(str);
+}
+
+/**
+ * Thread running the UDP echo server on node 0
+ *
+ * @return NULL
+ */
+static void* serverThread(void*)
+{
+    EtherSia_VirtualSwitch ether(vswitch);
+    MACAddress mac;
+    IPv6Address address;
+    nodeAddresses(0, mac, address);
+    ether.setGlobalAddress(address);
+    ether.begin(mac);
+
+    UDPSocket udp(ether, ECHO_PORT);
+    while (!finished) {
+        ether.waitForPacket(100);
+        ether.receivePacket();
+        if (udp.havePacket()) {
+            udp.sendReply(udp.payload(), udp.payloadLength());
+        }
+    }
+
+    ether.end();
+    return NULL;
+}
+
+/**
+ * Thread running a client node, which sends one packet to the server
+ *
+ * @param arg the node number
+ * @return NULL
+ */
+static void* clientThread(void *arg)
+{
+    int node = (int)(intptr_t)arg;
+    EtherSia_VirtualSwitch ether(vswitch);
+    MACAddress mac;
+    IPv6Address address;
+    nodeAddresses(node, mac, address);
+    ether.setGlobalAddress(address);
+    ether.begin(mac);
+
+    MACAddress serverMac;
+    IPv6Address serverAddress;
+    nodeAddresses(0, serverMac, serverAddress);
+
+    UDPSocket udp(ether);
+    udp.setRemoteAddress(serverAddress, ECHO_PORT);
+    udp.send("ping");
+
+    double start = now();
+    while (now() - start < REPLY_TIMEOUT) {
+        ether.waitForPacket(100);
+        ether.receivePacket();
+        if (udp.havePacket() && udp.payloadEquals("ping")) {
+            pthread_mutex_lock(&successLock);
+            successes++;
+            pthread_mutex_unlock(&successLock);
+            break;
+        }
+    }
+
+    ether.end();
+    return NULL;
+}
+
+/**
+ * Main function in Virtual Switch Simulation example
+ *
+ * @param argc the number of command line arguments
+ * @param argv the command line arguments
+ * @return 0 if successful
+ */
+int main(int argc, char *argv[])
+{
+    int nodes = 500;
+    if (argc > 1 && sscanf(argv[1], "%d", &nodes) != 1) {
+        nodes = 0;
+    }
+    if (nodes < 2 || nodes > VSWITCH_MAX_PORTS) {
+        fprintf(stderr, "Number of nodes must be between 2 and %d\n", VSWITCH_MAX_PORTS);
+        return 1;
+    }
+
+    Serial.println("[EtherSia VirtualSwitchSimulation]");
+    if (vswitch.begin() == false) {
+        Serial.println("Failed to create virtual switch");
+        return 1;
+    }
+
+    pthread_t server;
+    pthread_t *clients = new pthread_t[nodes - 1];
+    double start = now();
+
+    pthread_create(&server, NULL, serverThread, NULL);
+    for (int i = 1; i < nodes; i++) {
+        pthread_create(&clients[i - 1], NULL, clientThread, (void*)(intptr_t)i);
+    }
+
+    for (int i = 1; i < nodes; i++) {
+        pthread_join(clients[i - 1], NULL);
+    }
+    finished = true;
+    pthread_join(server, NULL);
+
+    printf("Nodes:              %d\n", nodes);
+    printf("Clients answered:   %d\n", successes);
+    printf("Time taken:         %.3f seconds\n", now() - start);
+    printf("Frames forwarded:   %lu\n", (unsigned long)vswitch.framesForwarded());
+    printf("Frames flooded:     %lu\n", (unsigned long)vswitch.framesFlooded());
+    printf("Frames dropped:     %lu\n", (unsigned long)vswitch.framesDropped());
+
+    delete[] clients;
+    vswitch.end();
+
+    return 0;
+}
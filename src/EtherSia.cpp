@@ -15,6 +15,32 @@ EtherSia::EtherSia()
 
     // Use stateless auto-configuration by default
     _autoConfigurationEnabled = true;
+
+    _buffer = _frameBuffer;
+    _savedBuffer = NULL;
+    _bufferContainsReceived = false;
+    _bufferChecksumVerified = false;
+    _frameChecksumValid = false;
+
+#if ETHERSIA_RX_RING_SIZE > 0
+    for (uint8_t i = 0; i < ETHERSIA_RX_RING_SIZE; i++) {
+        _rxRing[i].state = RX_SLOT_FREE;
+        _rxRing[i].data = _rxRing[i].frame;
+    }
+    _rxQueueHead = 0;
+    _rxQueueCount = 0;
+#endif
+
+    // Start with an empty Neighbour Cache
+    for (uint8_t i = 0; i < NEIGHBOUR_CACHE_SIZE; i++) {
+        _neighbourCache[i].state = NEIGHBOUR_STATE_EMPTY;
+    }
+
+#if NEIGHBOUR_QUEUE_SIZE > 0
+    for (uint8_t i = 0; i < NEIGHBOUR_QUEUE_SIZE; i++) {
+        _neighbourQueue[i].length = 0;
+    }
+#endif
 }
 
 
@@ -107,20 +133,68 @@ boolean EtherSia::checkEthernetAddresses(IPv6Packet &packet) {
     return true;
 }
 
+boolean EtherSia::filterPacket(IPv6Packet &packet)
+{
+    if (!packet.isValidHeader() || !checkEthernetAddresses(packet)) {
+        return false;
+    }
+
+    uint8_t type = isOurAddress(packet.destination());
+    if (type == 0) {
+        // Not addressed to us (or a multicast group we aren't in)
+        return false;
+    }
+
+    if (type == ADDRESS_TYPE_MULTICAST) {
+        // Only ICMPv6 and UDP make sense for multicast
+        // Don't let anything else through, as rejectPacket() ignores multicast anyway
+        if (packet.protocol() != IP6_PROTO_ICMP6 && packet.protocol() != IP6_PROTO_UDP) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 uint16_t EtherSia::receivePacket()
 {
-    uint16_t len = readFrame(_buffer, sizeof(_buffer));
+    // Always receive into the receive buffer
+    selectReceiveBuffer();
+
+#if ETHERSIA_RX_RING_SIZE > 0
+    // Finished with the previous packet
+    rxRingReleaseCurrent();
+
+    // Send any Neighbour Solicitations that are due
+    neighbourProcessTimers();
+
+    // Drain the Ethernet controller, then take the oldest packet
+    rxRingFill();
+    uint16_t len = rxRingNext();
+#else
+    // Send any Neighbour Solicitations that are due, before the buffer is re-used
+    neighbourProcessTimers();
+
+    _frameChecksumValid = false;
+    uint16_t len = readFrame(_buffer, ETHERSIA_MAX_PACKET_SIZE);
+#endif
 
     if (len) {
-        IPv6Packet& packet = (IPv6Packet&)_ptr;
-        if (!packet.isValid() || !checkEthernetAddresses(packet)) {
+        IPv6Packet& packet = (IPv6Packet&)*_buffer;
+        if (!filterPacket(packet)) {
             _bufferContainsReceived = false;
             return 0;
         }
 
+        // The checksum is only verified once something wants to use the packet
         _bufferContainsReceived = true;
+        _bufferChecksumVerified = _frameChecksumValid;
 
         if (packet.protocol() == IP6_PROTO_ICMP6) {
+            if (!verifyChecksum()) {
+                return 0;
+            }
+
             boolean handled = icmp6ProcessPacket();
             if (handled) {
                 // Packet has already been handled, don't return it
@@ -136,9 +210,46 @@ uint16_t EtherSia::receivePacket()
     return len;
 }
 
+boolean EtherSia::waitForPacket(uint16_t timeout)
+{
+    if (packetsWaiting()) {
+        return true;
+    }
+
+    // Wake up in time to retransmit Neighbour Solicitations
+    return waitForFrame(neighbourTimerDue(timeout));
+}
+
+boolean EtherSia::waitForFrame(uint16_t timeout)
+{
+    (void)timeout;
+    return true;
+}
+
+boolean EtherSia::verifyChecksum()
+{
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
+
+    if (!_bufferContainsReceived) {
+        return false;
+    }
+
+    if (!_bufferChecksumVerified) {
+        // Verify the packet checksum (it should add up to 0)
+        if (packet.calculateChecksum() != 0) {
+            _bufferContainsReceived = false;
+            return false;
+        }
+
+        _bufferChecksumVerified = true;
+    }
+
+    return true;
+}
+
 void EtherSia::rejectPacket()
 {
-    IPv6Packet& packet = (IPv6Packet&)_ptr;
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
 
     // Ignore packets we have already replied to
     if (!_bufferContainsReceived)
@@ -148,6 +259,10 @@ void EtherSia::rejectPacket()
     if (packet.destination().isMulticast())
         return;
 
+    // Don't reply to corrupted packets
+    if (!verifyChecksum())
+        return;
+
     if (packet.protocol() == IP6_PROTO_TCP) {
         // Reply with TCP RST packet
         tcpSendRSTReply();
@@ -162,9 +277,43 @@ void EtherSia::rejectPacket()
     }
 }
 
+IPv6Packet& EtherSia::selectTransmitBuffer()
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    uint8_t *txBuffer = _frameBuffer;
+#elif ETHERSIA_TX_BUFFER
+    uint8_t *txBuffer = _txFrameBuffer;
+#else
+    uint8_t *txBuffer = _buffer;
+#endif
+
+    if (_savedBuffer == NULL && txBuffer != _buffer) {
+        _savedBuffer = _buffer;
+        _savedContainsReceived = _bufferContainsReceived;
+        _savedChecksumVerified = _bufferChecksumVerified;
+
+        _buffer = txBuffer;
+        _bufferContainsReceived = false;
+    }
+
+    return (IPv6Packet&)*_buffer;
+}
+
+IPv6Packet& EtherSia::selectReceiveBuffer()
+{
+    if (_savedBuffer) {
+        _buffer = _savedBuffer;
+        _bufferContainsReceived = _savedContainsReceived;
+        _bufferChecksumVerified = _savedChecksumVerified;
+        _savedBuffer = NULL;
+    }
+
+    return (IPv6Packet&)*_buffer;
+}
+
 void EtherSia::prepareSend()
 {
-    IPv6Packet& packet = (IPv6Packet&)_ptr;
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
 
     _bufferContainsReceived = false;
 
@@ -181,7 +330,7 @@ void EtherSia::prepareSend()
 
 void EtherSia::prepareReply()
 {
-    IPv6Packet& packet = (IPv6Packet&)_ptr;
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
     IPv6Address destination = packet.source();
     MACAddress etherDestination = packet.etherSource();
 
@@ -193,27 +342,63 @@ void EtherSia::prepareReply()
 
 void EtherSia::send()
 {
-    IPv6Packet& packet = (IPv6Packet&)_ptr;
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
 
     _bufferContainsReceived = false;
 
+    if (packet.etherDestination().isZero() && inOurSubnet(packet.destination())) {
+        MACAddress *mac = lookupNeighbour(packet.destination());
+        if (mac) {
+            packet.setEtherDestination(*mac);
+        } else {
+            // Hold on to the packet until Neighbour Discovery has completed
+            IPv6Address destination = packet.destination();
+            neighbourQueuePacket();
+            resolveNeighbour(destination);
+            return;
+        }
+    }
+
     sendFrame(_buffer, packet.length());
 }
 
 void EtherSia::tcpSendRSTReply()
 {
-    IPv6Packet& packet = (IPv6Packet&)_ptr;
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
     struct tcp_header *tcpHeader = TCP_HEADER_PTR;
-    uint32_t seqNum = htonl(tcpHeader->sequenceNum);
+    uint8_t flags = tcpHeader->flags;
+    uint32_t seqNum = ntohl(tcpHeader->sequenceNum);
+    uint32_t ackNum = ntohl(tcpHeader->acknowledgementNum);
     uint16_t sourcePort = tcpHeader->sourcePort;
 
+    if (flags & TCP_FLAG_RST) {
+        // Never reply to a reset
+        return;
+    }
+
+    // The length of the segment includes the SYN and FIN flags
+    uint32_t segmentLength = packet.payloadLength() - ((tcpHeader->dataOffset >> 4) * 4);
+    if (flags & TCP_FLAG_SYN) {
+        segmentLength++;
+    }
+    if (flags & TCP_FLAG_FIN) {
+        segmentLength++;
+    }
+
     prepareReply();
     tcpHeader->sourcePort = tcpHeader->destinationPort;
     tcpHeader->destinationPort = sourcePort;
-    tcpHeader->sequenceNum = 0;
-    tcpHeader->acknowledgementNum = htonl(seqNum + 1);
+    if (flags & TCP_FLAG_ACK) {
+        // Use the sequence number that the other end is expecting (RFC793)
+        tcpHeader->sequenceNum = htonl(ackNum);
+        tcpHeader->acknowledgementNum = 0;
+        tcpHeader->flags = TCP_FLAG_RST;
+    } else {
+        tcpHeader->sequenceNum = 0;
+        tcpHeader->acknowledgementNum = htonl(seqNum + segmentLength);
+        tcpHeader->flags = TCP_FLAG_ACK | TCP_FLAG_RST;
+    }
     tcpHeader->dataOffset = (TCP_MINIMUM_HEADER_LEN / 4) << 4;
-    tcpHeader->flags = TCP_FLAG_ACK | TCP_FLAG_RST;
     tcpHeader->window = 0;
     tcpHeader->urgentPointer = 0;
 
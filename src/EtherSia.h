@@ -44,6 +44,66 @@
 /** How many times to send Neighbour Solicitation (NS) packets */
 #define NEIGHBOUR_SOLICITATION_ATTEMPTS  (5)
 
+#ifndef NEIGHBOUR_CACHE_SIZE
+/**
+ * The number of IPv6 to MAC address mappings to remember
+ *
+ * When the cache is full, the least recently confirmed entry is replaced.
+ */
+#define NEIGHBOUR_CACHE_SIZE             (4)
+#endif
+
+/** How long (in milliseconds) a neighbour is considered reachable after confirmation (RFC4861 REACHABLE_TIME) */
+#define NEIGHBOUR_REACHABLE_TIME         (30000)
+
+#ifndef NEIGHBOUR_QUEUE_SIZE
+#ifdef __AVR__
+#define NEIGHBOUR_QUEUE_SIZE             (0)
+#else
+/**
+ * The number of outgoing packets to hold while waiting for Neighbour Discovery
+ *
+ * Each queued packet uses ETHERSIA_MAX_PACKET_SIZE bytes of RAM, so this
+ * defaults to 0 on AVR. Without a queue, Socket::setRemoteAddress() falls back
+ * to blocking until the neighbour has been discovered.
+ */
+#define NEIGHBOUR_QUEUE_SIZE             (1)
+#endif
+#endif
+
+#ifndef ETHERSIA_RX_RING_SIZE
+#ifdef __AVR__
+#define ETHERSIA_RX_RING_SIZE            (0)
+#else
+/**
+ * The number of received packets that can be waiting to be processed
+ *
+ * When this is greater than 0, receivePacket() reads all the frames waiting
+ * in the Ethernet controller into a ring of buffers in one go, and then
+ * returns them one at a time. This stops bursts of packets being lost while
+ * the application is busy. Each slot uses ETHERSIA_MAX_PACKET_SIZE bytes of
+ * RAM, so this defaults to 0 on AVR, where frames are read straight into
+ * the packet buffer.
+ */
+#define ETHERSIA_RX_RING_SIZE            (4)
+#endif
+#endif
+
+#ifndef ETHERSIA_TX_BUFFER
+/**
+ * Set to 1 to give packets being sent their own buffer, when the receive ring is disabled
+ *
+ * This uses an extra ETHERSIA_MAX_PACKET_SIZE bytes of RAM. When the receive
+ * ring is enabled, the received packets are stored in the ring, so the
+ * ordinary packet buffer is used for sending and this setting isn't needed.
+ * See EtherSia::selectTransmitBuffer().
+ */
+#define ETHERSIA_TX_BUFFER               (0)
+#endif
+
+#include "neighbour.h"
+#include "ring.h"
+
 
 /**
  * Main class for sending and receiving IPv6 messages using the ENC28J60 Ethernet controller
@@ -237,10 +297,45 @@ public:
      * Check if there is an IPv6 packet waiting for us and copy it into the buffer.
      * If there is no packet available this method returns 0.
      *
+     * If the receive ring is enabled (ETHERSIA_RX_RING_SIZE), all the frames
+     * waiting in the Ethernet controller are read into the ring first, and
+     * the packet buffer then points at the oldest one. Any packets left in the
+     * ring are returned by the following calls, see packetsWaiting().
+     *
+     * To avoid checksumming packets that nothing wants, the checksum of
+     * non-ICMPv6 packets is not verified until a socket claims the packet.
+     * If you are handling packets without a socket, call verifyChecksum().
+     *
      * @return The length of the packet, or 0 if no packet was received
      */
     uint16_t receivePacket();
 
+    /**
+     * Wait until there might be a packet to receive, or the timeout expires
+     *
+     * Use this in loops that call receivePacket(), to avoid spinning the CPU
+     * while nothing is happening. The wait is cut short when a Neighbour
+     * Solicitation is due to be retransmitted. Drivers that can't sleep until
+     * a frame arrives return straight away, so it is always safe to call
+     * receivePacket() afterwards.
+     *
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return false if the timeout expired without a frame arriving
+     */
+    boolean waitForPacket(uint16_t timeout);
+
+    /**
+     * Verify the checksum of the received packet in the packet buffer
+     *
+     * The result is remembered, so the checksum is only calculated once
+     * per packet. It is skipped entirely if the driver reported that the
+     * frame had already been verified. If the checksum is wrong, the
+     * packet is discarded and bufferContainsReceived() will return false.
+     *
+     * @return true if the buffer contains a received packet with a valid checksum
+     */
+    boolean verifyChecksum();
+
     /**
      * Check the received packet, and reply with a rejection packet.
      *
@@ -280,11 +375,65 @@ public:
      */
     inline IPv6Packet& packet()
     {
-        return (IPv6Packet&)_ptr;
+        return (IPv6Packet&)*_buffer;
     }
 
+    /**
+     * Take the received packet out of the packet buffer, without copying it
+     *
+     * The packet stays in its receive ring slot until releasePacket() is
+     * called, so later calls to receivePacket() and send() won't overwrite it.
+     * After borrowing, packet() no longer refers to the borrowed packet.
+     *
+     * @note Borrowed packets use up slots in the receive ring, so release them promptly.
+     * @return A pointer to the received packet, or NULL if there is no
+     *         received packet or the receive ring is disabled
+     */
+    IPv6Packet* borrowPacket();
+
+    /**
+     * Give a packet returned by borrowPacket() back to the receive ring
+     *
+     * @param packet The borrowed packet
+     */
+    void releasePacket(IPv6Packet *packet);
+
+    /**
+     * Point the packet buffer at the transmit buffer, keeping the received packet
+     *
+     * Use this to send new packets (for example a Syslog message) while
+     * handling a received packet, without overwriting it. Call
+     * selectReceiveBuffer() afterwards to get back to the received packet,
+     * for example to send a reply to it.
+     *
+     * @note The transmit buffer is only separate if the receive ring is
+     *       enabled or ETHERSIA_TX_BUFFER is set, otherwise this does nothing.
+     * @return A reference to the packet in the transmit buffer
+     */
+    IPv6Packet& selectTransmitBuffer();
+
+    /**
+     * Point the packet buffer back at the received packet, after selectTransmitBuffer()
+     *
+     * @return A reference to the received packet
+     */
+    IPv6Packet& selectReceiveBuffer();
+
+    /**
+     * Get the number of received packets waiting in the receive ring
+     *
+     * These are returned, one at a time, by the next calls to receivePacket().
+     *
+     * @return The number of packets waiting
+     */
+    uint8_t packetsWaiting();
+
     /**
      * Send the packet currently in the packet buffer.
+     *
+     * If the Ethernet Destination is all-zeros and the IPv6 destination is on
+     * our subnet, the packet is queued and Neighbour Discovery is started.
+     * The packet is sent once the neighbour's MAC address is known.
      */
     void send();
 
@@ -332,6 +481,10 @@ public:
      * Perform Neighbour Discovery for an IPv6 address on the local subnet
      *
      * This method takes an IPv6 address and resolves it to a MAC address.
+     * If the address is already in the Neighbour Cache, the cached MAC
+     * address is returned straight away, without sending any packets.
+     * Otherwise this method blocks until discovery has completed - use
+     * resolveNeighbour() to avoid blocking.
      *
      * It is recommended that this method is called within setup(),
      * to avoid packets being lost within loop().
@@ -346,6 +499,10 @@ public:
      * Perform Neighbour Discovery for an IPv6 address on the local subnet
      *
      * This method takes an IPv6 address and resolves it to a MAC address.
+     * If the address is already in the Neighbour Cache, the cached MAC
+     * address is returned straight away, without sending any packets.
+     * Otherwise this method blocks until discovery has completed - use
+     * resolveNeighbour() to avoid blocking.
      *
      * It is recommended that this method is called within setup(),
      * to avoid packets being lost within loop().
@@ -358,7 +515,33 @@ public:
     MACAddress* discoverNeighbour(IPv6Address& address, uint8_t attempts=NEIGHBOUR_SOLICITATION_ATTEMPTS);
 
     /**
-     * Send a reply with a TCP RST packet
+     * Start or continue Neighbour Discovery for an IPv6 address, without blocking
+     *
+     * If the address is in the Neighbour Cache, the MAC address is returned
+     * straight away. Otherwise a Neighbour Solicitation is sent (using the
+     * packet buffer) and NULL is returned; retransmissions and the Neighbour
+     * Advertisement are handled by receivePacket(), so call this method again
+     * later to see if discovery has completed.
+     *
+     * @param address The IPv6 address to resolve
+     * @param attempts The number of ICMPv6 packets to send before giving up
+     * @return An pointer to a MAC address or NULL if the address has not been resolved yet
+     */
+    MACAddress* resolveNeighbour(IPv6Address& address, uint8_t attempts=NEIGHBOUR_SOLICITATION_ATTEMPTS);
+
+    /**
+     * Look up an IPv6 address in the Neighbour Cache, without sending any packets
+     *
+     * @param address The IPv6 address to look up
+     * @return An pointer to a MAC address or NULL if the address is not known
+     */
+    MACAddress* lookupNeighbour(const IPv6Address& address);
+
+    /**
+     * Send a reply with a TCP RST packet, for a segment that isn't part of a connection
+     *
+     * The sequence numbers are chosen as described in RFC793, so that the
+     * other end accepts the reset. Nothing is sent in reply to a reset.
      */
     void tcpSendRSTReply();
 
@@ -379,6 +562,40 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize) = 0;
 
+    /**
+     * Wait for an Ethernet frame to arrive
+     *
+     * The default implementation returns immediately; drivers that can
+     * block until a frame arrives (such as on Linux) override it.
+     *
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return false if the timeout expired without a frame arriving
+     */
+    virtual boolean waitForFrame(uint16_t timeout);
+
+    /**
+     * Lend the next received Ethernet frame to EtherSia, without copying it
+     *
+     * Drivers that receive frames into memory of their own can override
+     * this, so that the receive ring points the packet buffer straight at
+     * the frame. Replies are built in place, so there must be room for
+     * ETHERSIA_MAX_PACKET_SIZE bytes. The frame belongs to EtherSia until
+     * it is passed to returnFrame(). Only used if the receive ring is enabled.
+     *
+     * The default implementation returns NULL, and readFrame() is used instead.
+     *
+     * @param length Set to the length of the frame
+     * @return A pointer to the frame, or NULL if there is no frame to lend
+     */
+    virtual uint8_t* lendFrame(uint16_t *length);
+
+    /**
+     * Give a frame that was lent by lendFrame() back to the driver
+     *
+     * @param frame The pointer that lendFrame() returned
+     */
+    virtual void returnFrame(uint8_t *frame);
+
 protected:
     IPv6Address _linkLocalAddress;  /**< The IPv6 Link-local address of the Ethernet Interface */
     IPv6Address _globalAddress;     /**< The IPv6 Global address of the Ethernet Interface */
@@ -390,15 +607,60 @@ protected:
     /** The MAC Address of the router to send packets outside of this subnet */
     MACAddress _routerMac;
 
-    /** The buffer that sent and received packets are stored in */
-    union {
-        uint8_t _buffer[ETHERSIA_MAX_PACKET_SIZE];
-        void* _ptr;
-    };
+    /** The buffer that packets are sent from (and received into if there is no receive ring) */
+    uint8_t _frameBuffer[ETHERSIA_MAX_PACKET_SIZE];
+
+    /** The packet buffer: either _frameBuffer or the receive ring slot of the current packet */
+    uint8_t *_buffer;
+
+#if ETHERSIA_TX_BUFFER && ETHERSIA_RX_RING_SIZE == 0
+    /** Separate buffer for building packets to send, when there is no receive ring */
+    uint8_t _txFrameBuffer[ETHERSIA_MAX_PACKET_SIZE];
+#endif
+
+    /** The packet buffer that was selected before selectTransmitBuffer(), or NULL */
+    uint8_t *_savedBuffer;
+
+    /** The value of _bufferContainsReceived before selectTransmitBuffer() */
+    boolean _savedContainsReceived;
+
+    /** The value of _bufferChecksumVerified before selectTransmitBuffer() */
+    boolean _savedChecksumVerified;
+
+#if ETHERSIA_RX_RING_SIZE > 0
+    /** Ring of buffers for received packets, waiting to be processed */
+    struct rx_slot _rxRing[ETHERSIA_RX_RING_SIZE];
+
+    /** Indexes of the queued slots in _rxRing, in the order they were received */
+    uint8_t _rxQueue[ETHERSIA_RX_RING_SIZE];
+
+    /** Position of the oldest entry in _rxQueue */
+    uint8_t _rxQueueHead;
+
+    /** Number of entries in _rxQueue */
+    uint8_t _rxQueueCount;
+#endif
 
     /** Flag indicating if the buffer contains a valid packet we received */
     boolean _bufferContainsReceived;
 
+    /** Flag indicating if the checksum of the received packet has been verified */
+    boolean _bufferChecksumVerified;
+
+    /**
+     * Flag set by drivers in readFrame(), if the Ethernet controller or
+     * operating system has already verified the checksum of the frame
+     */
+    boolean _frameChecksumValid;
+
+    /** Cache of IPv6 address to MAC address mappings for the local subnet */
+    struct neighbour_entry _neighbourCache[NEIGHBOUR_CACHE_SIZE];
+
+#if NEIGHBOUR_QUEUE_SIZE > 0
+    /** Outgoing packets waiting for Neighbour Discovery to complete */
+    struct neighbour_queued_packet _neighbourQueue[NEIGHBOUR_QUEUE_SIZE];
+#endif
+
     /** Flag indicating if the buffer contains a valid packet we received */
     boolean _autoConfigurationEnabled;
 
@@ -408,6 +670,20 @@ protected:
      */
     boolean checkEthernetAddresses(IPv6Packet &packet);
 
+    /**
+     * Cheap checks on a received packet's headers, before any checksum is calculated
+     *
+     * Checks the EtherType, IP version, Ethernet addresses, that the IPv6
+     * destination is one of our addresses and that the protocol makes sense
+     * for that address. This only looks at the headers.
+     *
+     * Drivers can call this once they have read the first sizeof(IPv6Packet)
+     * bytes of a frame, and skip reading the rest of the frame if it fails.
+     *
+     * @return true if packet should be accepted
+     */
+    boolean filterPacket(IPv6Packet &packet);
+
     /**
      * Process a received ICMPv6 packet in the packet buffer
      *
@@ -460,13 +736,115 @@ protected:
      */
     void icmp6ProcessRA();
 
+    /**
+     * Record a link-layer address option from a Neighbour Solicitation or Router Advertisement
+     *
+     * Creates a STALE Neighbour Cache entry, or marks the existing one STALE
+     * if the link-layer address has changed.
+     *
+     * @param address The IPv6 address of the sender
+     * @param mac The link-layer address given in the option
+     */
+    void icmp6NeighbourSeen(IPv6Address &address, MACAddress &mac);
+
     /**
      * Handle a ICMPv6 Neighbour Advertisement (NA) packet
      *
-     * @param expected The IPv6 address we are expecting a response about
-     * @return Target Link Address, if successful, otherwise NULL
+     * Updates the Neighbour Cache entry for the target address,
+     * if there is one.
+     */
+    void icmp6ProcessNA();
+
+    /**
+     * Find the entry for an IPv6 address in the Neighbour Cache
+     *
+     * REACHABLE entries that have not been confirmed within
+     * NEIGHBOUR_REACHABLE_TIME are changed to STALE.
+     *
+     * @param address The IPv6 address to look up
+     * @return A pointer to the cache entry, or NULL if there isn't one
+     */
+    struct neighbour_entry* neighbourCacheLookup(const IPv6Address &address);
+
+    /**
+     * Add or update an entry in the Neighbour Cache
+     *
+     * If there is no existing entry for the address, an empty entry
+     * (or the least recently confirmed one) is used.
+     *
+     * @param address The IPv6 address of the neighbour
+     * @param mac The MAC address of the neighbour, or NULL if it is not known yet
+     * @param state The new state of the entry (a neighbourState)
+     * @return A pointer to the cache entry
+     */
+    struct neighbour_entry* neighbourCacheUpdate(const IPv6Address &address, const MACAddress *mac, uint8_t state);
+
+    /**
+     * Send a Neighbour Solicitation for an INCOMPLETE Neighbour Cache entry
+     *
+     * @param entry The Neighbour Cache entry to solicit
+     */
+    void neighbourSolicit(struct neighbour_entry *entry);
+
+    /**
+     * Retransmit Neighbour Solicitations that are due and expire failed discoveries
+     *
+     * This is called by receivePacket(), before the next packet is read.
+     */
+    void neighbourProcessTimers();
+
+    /**
+     * Get the time until the next Neighbour Solicitation is due
+     *
+     * @param limit The maximum value to return (in milliseconds)
+     * @return The number of milliseconds until neighbourProcessTimers() has work to do
+     */
+    uint16_t neighbourTimerDue(uint16_t limit);
+
+    /**
+     * Copy the packet in the packet buffer to the queue of packets waiting for Neighbour Discovery
+     *
+     * @return true if the packet was queued, false if the queue is full
+     */
+    boolean neighbourQueuePacket();
+
+    /**
+     * Send or discard all the queued packets for a neighbour
+     *
+     * @param entry The Neighbour Cache entry that has changed state
+     */
+    void neighbourQueueFlush(struct neighbour_entry *entry);
+
+    /**
+     * Read all the frames waiting in the Ethernet controller into free slots of the receive ring
+     *
+     * Drivers can make consecutive calls to readFrame() cheaper than the
+     * first, for example by only checking how many frames are waiting once.
+     *
+     * @return The number of frames read
+     */
+    uint8_t rxRingFill();
+
+    /**
+     * Make the oldest packet in the receive ring the current packet buffer
+     *
+     * @return The length of the packet, or 0 if the ring is empty
+     */
+    uint16_t rxRingNext();
+
+    /**
+     * Free the receive ring slot of the current packet (unless it has been borrowed)
+     *
+     * The packet buffer is then pointed back at _frameBuffer.
+     */
+    void rxRingReleaseCurrent();
+
+    /**
+     * Mark a receive ring slot as free, returning any frame lent by the driver
+     *
+     * @param slot The slot to free
      */
-    MACAddress* icmp6ProcessNA(IPv6Address &expected);
+    void rxRingFreeSlot(struct rx_slot *slot);
 
     /**
      * Handle a single Prefix from a Router Advertisement (RA) packet
@@ -482,6 +860,7 @@ protected:
 
 #include "PingClient.h"
 #include "TCPServer.h"
+#include "TCPClient.h"
 #include "HTTPServer.h"
 #include "TFTPServer.h"
 #include "Syslog.h"
@@ -493,6 +872,8 @@ protected:
 #ifndef ARDUINO
 #include "dummy.h"
 #include "LinuxSocket.h"
+#include "LinuxXDP.h"
+#include "VirtualSwitch.h"
 #endif
 
 
@@ -15,11 +15,15 @@ const char PROGMEM HTTPServer::methodPost[] = "POST";
 const char PROGMEM HTTPServer::methodPut[] = "PUT";
 const char PROGMEM HTTPServer::methodDelete[] = "DELETE";
 
+const char PROGMEM HTTPServer::headerContentLength[] = "Content-Length:";
+
 
 
 HTTPServer::HTTPServer(EtherSia &ether, uint16_t localPort) : TCPServer(ether, localPort)
 {
     _bodyPtr = NULL;
+    _contentLength = 0;
+    _bodyRemaining = 0;
 }
 
 void HTTPServer::printStatus(const __FlashStringHelper* status)
@@ -113,19 +117,77 @@ boolean HTTPServer::checkRequest(const char* method, const __FlashStringHelper*
             return false;
     }
 
-    // Find the start of the body section
+    // Find the end of the headers and the start of the body section
+    uint16_t endOfHeaders = length;
     _bodyPtr = NULL;
-    for(pos = endOfMethod+1; pos < length-1; pos++) {
+    for(pos = endOfMethod+1; pos < length; pos++) {
         if (payload[pos] == '\n' && (payload[pos-2] == '\n' || payload[pos-1] == '\n')) {
-            // Store the location of the start of the body
-            _bodyPtr = &payload[pos+1];
+            endOfHeaders = pos+1;
+            if (endOfHeaders < length) {
+                // Store the location of the start of the body
+                _bodyPtr = &payload[endOfHeaders];
 
-            // For convenience NULL-terminate the body
-            payload[length] = '\0';
+                // For convenience NULL-terminate the body
+                payload[length] = '\0';
+            }
             break;
         }
     }
 
+    // Work out how much of the body is still to come
+    _contentLength = parseContentLength(payload, endOfHeaders);
+    if (_contentLength > bodyLength()) {
+        _bodyRemaining = _contentLength - bodyLength();
+    } else {
+        _bodyRemaining = 0;
+    }
+
+    return true;
+}
+
+uint32_t HTTPServer::parseContentLength(const char* headers, uint16_t length)
+{
+    uint16_t nameLen = strlen_P(headerContentLength);
+    uint32_t value = 0;
+
+    // Look at the start of each line
+    for(uint16_t pos = 1; pos + nameLen < length; pos++) {
+        if (headers[pos-1] != '\n' || strncasecmp_P(&headers[pos], headerContentLength, nameLen) != 0)
+            continue;
+
+        pos += nameLen;
+        while (pos < length && headers[pos] == ' ')
+            pos++;
+
+        for(; pos < length && headers[pos] >= '0' && headers[pos] <= '9'; pos++) {
+            value = (value * 10) + (headers[pos] - '0');
+        }
+        break;
+    }
+
+    return value;
+}
+
+boolean HTTPServer::receiveBody()
+{
+    if (_bodyRemaining == 0 || !receiveMore()) {
+        _bodyRemaining = 0;
+        return false;
+    }
+
+    char* payload = (char*)this->payload();
+    uint16_t length = payloadLength();
+
+    // The whole of the new segment is part of the body
+    _bodyPtr = payload;
+    payload[length] = '\0';
+
+    if (length < _bodyRemaining) {
+        _bodyRemaining -= length;
+    } else {
+        _bodyRemaining = 0;
+    }
+
     return true;
 }
 
@@ -103,9 +103,8 @@ public:
     /**
      * Get the body section of the HTTP request as a C string
      *
-     * @warning Some browsers (eg Safari) send the HTTP request headers
-     * and the request body in seperate TCP segments. In this case EtherSia
-     * is unable to see the response body.
+     * @note Only the part of the body in the current TCP segment is available.
+     * Use receiveBody() to get the rest of it.
      *
      * @return Pointer to the body or NULL if the body is empty
      */
@@ -119,22 +118,47 @@ public:
     inline char* path() { return _pathPtr; }
 
     /**
-     * Get the length of the HTTP body
-     *
-     * @warning Annoyingly, some browsers (eg Safari) send the HTTP request headers
-     * and the request body in seperate TCP segments. In this case EtherSia
-     * is unable to see the response body.
+     * Get the length of the part of the HTTP body in the current TCP segment
      *
      * @return The length of the HTTP body (or 0 if there isn't one)
      */
     uint16_t bodyLength();
 
+    /**
+     * Get the length of the whole HTTP body, from the Content-Length header
+     *
+     * @return The number of bytes, or 0 if there was no Content-Length header
+     */
+    inline uint32_t contentLength() { return _contentLength; }
+
+    /**
+     * Receive the next part of a HTTP body that didn't fit in a single TCP segment
+     *
+     * The previous part of the body is acknowledged and then overwritten,
+     * so it must have been handled before calling this method. Afterwards,
+     * body() and bodyLength() return the new part. Some browsers (eg Safari)
+     * send the request headers and the body in seperate TCP segments,
+     * so this is also how to get the body in that case.
+     *
+     * Typical use is:
+     *
+     *     if (http.isPost(F("/config"))) {
+     *         do {
+     *             handleConfig(http.body(), http.bodyLength());
+     *         } while (http.receiveBody());
+     *         ...
+     *     }
+     *
+     * @note Please call this before writing the reply.
+     * @return true if another part of the body was received,
+     *         false if the whole body has been received, or the client stopped sending it
+     */
+    boolean receiveBody();
+
     /**
      * Check if request body equals the given C string
      *
-     * @warning Annoyingly, some browsers (eg Safari) send the HTTP request headers
-     * and the request body in seperate TCP segments. In this case EtherSia
-     * is unable to see the response body.
+     * @note Only the part of the body in the current TCP segment is compared.
      *
      * @param str The string to compare to
      * @return true if the body and string are equal
@@ -159,6 +183,21 @@ protected:
     /** A pointer path string for current request */
     char* _pathPtr;
 
+    /** The value of the Content-Length header of the current request */
+    uint32_t _contentLength;
+
+    /** The number of bytes of the body that haven't been received yet */
+    uint32_t _bodyRemaining;
+
+    /**
+     * Find the value of the Content-Length header in the HTTP request
+     *
+     * @param headers Pointer to the start of the request headers
+     * @param length The length of the request headers
+     * @return The value of the header, or 0 if there isn't one
+     */
+    uint32_t parseContentLength(const char* headers, uint16_t length);
+
     /**
      * Check if request is of method and path matches the incoming request
      *
@@ -172,6 +211,8 @@ protected:
     static const char PROGMEM methodPost[];    /**< String for POST method */
     static const char PROGMEM methodPut[];     /**< String for PUT method */
     static const char PROGMEM methodDelete[];  /**< String for DELETE method */
+
+    static const char PROGMEM headerContentLength[];  /**< String for Content-Length header */
 };
 
 
@@ -19,7 +19,9 @@
 #define ICMP6_CODE_PORT_UNREACHABLE  4
 #define ICMP6_CODE_UNRECOGNIZED_NH   1
 
+#define ICMP6_NA_FLAG_R           (1 << 7)
 #define ICMP6_NA_FLAG_S           (1 << 6)
+#define ICMP6_NA_FLAG_O           (1 << 5)
 
 #define ICMP6_OPTION_SOURCE_LINK_ADDRESS 1
 #define ICMP6_OPTION_TARGET_LINK_ADDRESS 2
@@ -26,17 +26,26 @@ uint8_t* IPv6Packet::payload()
 
 boolean IPv6Packet::isValid()
 {
-    if (this->_etherType != ntohs(ETHER_TYPE_IPV6)) {
+    if (!isValidHeader()) {
         return false;
     }
 
-    // Check the version header
-    if (this->version() != 6) {
+    // Verify the packet checksum (it should add up to 0)
+    if (calculateChecksum() != 0) {
         return false;
     }
 
-    // Verify the packet checksum (it should add up to 0)
-    if (calculateChecksum() != 0) {
+    return true;
+}
+
+boolean IPv6Packet::isValidHeader()
+{
+    if (this->_etherType != ntohs(ETHER_TYPE_IPV6)) {
+        return false;
+    }
+
+    // Check the version header
+    if (this->version() != 6) {
         return false;
     }
 
@@ -150,3 +159,24 @@ uint16_t IPv6Packet::calculateChecksum()
 
     return ~newsum;
 }
+
+uint16_t IPv6Packet::addressSum()
+{
+    uint16_t sum = chksum(0, (uint8_t *)(source()), 16);
+    return chksum(sum, (uint8_t *)(destination()), 16);
+}
+
+uint16_t IPv6Packet::adjustChecksum(uint16_t checksum, uint16_t oldSum, uint16_t newSum)
+{
+    uint16_t old = ntohs(checksum);
+    uint32_t sum = (uint16_t)~old;
+    sum += (uint16_t)~oldSum;
+    sum += newSum;
+
+    // Fold the carries back in
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+    uint16_t result = ~sum;
+    return htons(result);
+}
@@ -64,6 +64,14 @@ public:
      */
     boolean isValid();
 
+    /**
+     * Check if the Ethernet and IPv6 headers are valid
+     * This does not verify the checksum, so is much cheaper than isValid()
+     *
+     * @return true if the header fields are valid
+     */
+    boolean isValidHeader();
+
     /**
      * Marks the packet as being invalid, so that isValid()
      * returns false.
@@ -195,6 +203,29 @@ public:
      */
     uint16_t calculateChecksum();
 
+    /**
+     * Calculate the 16-bit one's complement sum of the source and destination addresses
+     *
+     * Use this with adjustChecksum() to update a checksum after
+     * the addresses have been changed.
+     *
+     * @return the sum of the addresses (in host byte order)
+     */
+    uint16_t addressSum();
+
+    /**
+     * Update a checksum after part of a packet has changed, without re-calculating it
+     *
+     * This uses the incremental update method described in RFC1624:
+     *     HC' = ~(~HC + ~m + m')
+     *
+     * @param checksum the current checksum field (in network byte order)
+     * @param oldSum the 16-bit one's complement sum of the data before it changed (in host byte order)
+     * @param newSum the 16-bit one's complement sum of the data after it changed (in host byte order)
+     * @return the new checksum field (in network byte order)
+     */
+    static uint16_t adjustChecksum(uint16_t checksum, uint16_t oldSum, uint16_t newSum);
+
 protected:
 
     // Ethernet Header
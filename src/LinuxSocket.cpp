@@ -38,9 +38,13 @@
 #include <sys/ioctl.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <poll.h>
 #include <net/if.h>
 #include <netinet/ether.h>
 #include <linux/if_packet.h>
+#include <linux/filter.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
@@ -55,6 +59,22 @@ EtherSia_LinuxSocket::EtherSia_LinuxSocket(const char* ifname)
     strncpy(this->ifname, ifname, sizeof(this->ifname)-1);
     ifindex = -1;
     sockfd = -1;
+    promiscuous = true;
+    useRings = false;
+    ring = NULL;
+    ringSize = 0;
+    rxRing = NULL;
+    rxFrame = NULL;
+    rxFramesLeft = 0;
+    rxBlock = 0;
+    txRing = NULL;
+    txFrameCount = 0;
+    txFrame = 0;
+    rxBatchCount = 0;
+    rxBatchNext = 0;
+    rxDrained = false;
+    batchSends = false;
+    txBatchCount = 0;
 }
 
 
@@ -77,15 +97,34 @@ EtherSia_LinuxSocket::begin(const MACAddress &address)
     /* Set non-blocking mode */
     fcntl(sockfd, F_SETFL, O_NONBLOCK);
 
-    /* Set interface to promiscuous mode */
-    struct ifreq ifopts;
-    int sockopt = 0;
-    strncpy(ifopts.ifr_name, ifname, IFNAMSIZ-1);
-    ioctl(sockfd, SIOCGIFFLAGS, &ifopts);
-    ifopts.ifr_flags |= IFF_PROMISC;
-    ioctl(sockfd, SIOCSIFFLAGS, &ifopts);
+    if (promiscuous) {
+        /* Set interface to promiscuous mode */
+        struct ifreq ifopts;
+        strncpy(ifopts.ifr_name, ifname, IFNAMSIZ-1);
+        ioctl(sockfd, SIOCGIFFLAGS, &ifopts);
+        ifopts.ifr_flags |= IFF_PROMISC;
+        ioctl(sockfd, SIOCSIFFLAGS, &ifopts);
+    } else {
+        /* Ask the interface for frames sent to our MAC address, and for IPv6 multicast */
+        struct packet_mreq mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = ifindex;
+        mreq.mr_type = PACKET_MR_UNICAST;
+        mreq.mr_alen = ETH_ALEN;
+        memcpy(mreq.mr_address, _localMac, ETH_ALEN);
+        if (setsockopt(sockfd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof mreq) == -1) {
+            perror("setsockopt(PACKET_MR_UNICAST)");
+        }
+
+        mreq.mr_type = PACKET_MR_ALLMULTI;
+        if (setsockopt(sockfd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof mreq) == -1) {
+            perror("setsockopt(PACKET_MR_ALLMULTI)");
+        }
+    }
 
     /* Allow the socket to be reused */
+    int sockopt = 0;
+
     if (setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &sockopt, sizeof sockopt) == -1) {
         perror("setsockopt(SO_REUSEADDR)");
         close(sockfd);
@@ -99,14 +138,191 @@ EtherSia_LinuxSocket::begin(const MACAddress &address)
         return false;
     }
 
+#ifdef TP_STATUS_CSUM_VALID
+    /* Ask the kernel to tell us if it has already verified checksums */
+    int auxdata = 1;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_AUXDATA, &auxdata, sizeof auxdata) == -1) {
+        perror("setsockopt(PACKET_AUXDATA)");
+    }
+#endif
+
+    /* Let the kernel throw away frames that aren't for us */
+    attachFilter();
+
+    if (useRings && !setupRings()) {
+        fprintf(stderr, "Falling back to recvmsg() and sendto()\n");
+    }
+
     return EtherSia::begin();
 }
 
+/* Add BPF instructions that jump to 'target' if the MAC address at 'offset' matches */
+static uint8_t bpfCompareMac(struct sock_filter *code, uint8_t n, uint32_t offset, const uint8_t *mac, uint8_t target)
+{
+    uint32_t high = ((uint32_t)mac[0] << 24) | ((uint32_t)mac[1] << 16) | ((uint32_t)mac[2] << 8) | mac[3];
+    uint16_t low = ((uint16_t)mac[4] << 8) | mac[5];
+    struct sock_filter compare[4] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, high, 0, 2),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, offset + 4),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, low, (uint8_t)(target - n - 4), 0)
+    };
+
+    memcpy(&code[n], compare, sizeof(compare));
+    return n + 4;
+}
+
+void
+EtherSia_LinuxSocket::attachFilter()
+{
+    MACAddress accept[4];
+    IPv6Address multicast;
+
+    accept[0] = _localMac;
+    multicast.setLinkLocalAllNodes();
+    accept[1].setIPv6Multicast(multicast);
+    multicast.setSolicitedNodeMulticastAddress(_linkLocalAddress);
+    accept[2].setIPv6Multicast(multicast);
+    multicast.setSolicitedNodeMulticastAddress(_globalAddress);
+    accept[3].setIPv6Multicast(multicast);
+
+    /*
+     * Drop frames sent from our MAC address, then compare the destination
+     * against each address in turn. Anything that doesn't match is dropped.
+     */
+    const uint8_t drop = 4 + (4 * 4);
+    const uint8_t pass = drop + 1;
+    struct sock_filter code[pass + 1];
+    uint8_t n = 0;
+
+    n = bpfCompareMac(code, n, 6, _localMac, drop);
+    for (uint8_t i = 0; i < 4; i++) {
+        n = bpfCompareMac(code, n, 0, accept[i], pass);
+    }
+
+    code[n++] = BPF_STMT(BPF_RET | BPF_K, 0);
+    code[n++] = BPF_STMT(BPF_RET | BPF_K, 0x40000);
+
+    struct sock_fprog prog;
+    prog.len = n;
+    prog.filter = code;
+    if (setsockopt(sockfd, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof prog) == -1) {
+        perror("setsockopt(SO_ATTACH_FILTER)");
+    }
+
+    filterLinkLocal = _linkLocalAddress;
+    filterGlobal = _globalAddress;
+}
+
+void
+EtherSia_LinuxSocket::updateFilter()
+{
+    if (filterLinkLocal != _linkLocalAddress || filterGlobal != _globalAddress) {
+        attachFilter();
+    }
+}
+
+/*---------------------------------------------------------------------------*/
+
+#ifdef TPACKET3_HDRLEN
+/* Remove the rings from a socket, so that recvmsg() and sendto() work on it again */
+static void releaseRings(int sockfd)
+{
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    setsockopt(sockfd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req);
+    setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req);
+}
+#endif
+
+boolean
+EtherSia_LinuxSocket::setupRings()
+{
+#ifdef TPACKET3_HDRLEN
+    int version = TPACKET_V3;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_VERSION, &version, sizeof version) == -1) {
+        perror("setsockopt(PACKET_VERSION)");
+        return false;
+    }
+
+    struct tpacket_req3 req;
+    memset(&req, 0, sizeof(req));
+    req.tp_block_size = LINUXSOCKET_RING_BLOCK_SIZE;
+    req.tp_block_nr = LINUXSOCKET_RING_BLOCK_COUNT;
+    req.tp_frame_size = LINUXSOCKET_RING_FRAME_SIZE;
+    req.tp_frame_nr = (req.tp_block_size / req.tp_frame_size) * req.tp_block_nr;
+    req.tp_retire_blk_tov = LINUXSOCKET_RING_BLOCK_TIMEOUT;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) == -1) {
+        perror("setsockopt(PACKET_RX_RING)");
+        return false;
+    }
+    ringSize = req.tp_block_size * req.tp_block_nr;
+
+    /* The transmit ring needs a kernel newer than 4.11 - carry on without it if not */
+    req.tp_retire_blk_tov = 0;
+    if (setsockopt(sockfd, SOL_PACKET, PACKET_TX_RING, &req, sizeof req) == 0) {
+        txFrameCount = req.tp_frame_nr;
+        ringSize *= 2;
+    }
+
+    /* Frames sent through the transmit ring go to the interface the socket is bound to */
+    struct sockaddr_ll sll;
+    memset(&sll, 0, sizeof(sll));
+    sll.sll_family = AF_PACKET;
+    sll.sll_protocol = htons(ETHER_TYPE_IPV6);
+    sll.sll_ifindex = ifindex;
+    if (bind(sockfd, (struct sockaddr*)&sll, sizeof(sll)) == -1) {
+        perror("bind(AF_PACKET)");
+        releaseRings(sockfd);
+        return false;
+    }
+
+    /* The receive ring comes first in the mapping, followed by the transmit ring */
+    void *mapped = mmap(NULL, ringSize, PROT_READ | PROT_WRITE, MAP_SHARED, sockfd, 0);
+    if (mapped == MAP_FAILED) {
+        perror("mmap(PACKET_RX_RING)");
+        releaseRings(sockfd);
+        ringSize = 0;
+        txFrameCount = 0;
+        return false;
+    }
+
+    ring = (uint8_t*)mapped;
+    rxRing = ring;
+    rxFrame = NULL;
+    rxFramesLeft = 0;
+    rxBlock = 0;
+    txRing = txFrameCount ? ring + (LINUXSOCKET_RING_BLOCK_SIZE * LINUXSOCKET_RING_BLOCK_COUNT) : NULL;
+    txFrame = 0;
+
+    return true;
+#else
+    fprintf(stderr, "TPACKET_V3 is not supported by these kernel headers\n");
+    return false;
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 
 uint16_t
 EtherSia_LinuxSocket::sendFrame(const uint8_t *data, uint16_t datalen)
 {
+    if (txRing) {
+        /* Once the socket has a transmit ring, the kernel ignores data passed to sendto() */
+        return sendRingFrame(data, datalen);
+    }
+
+    if (batchSends && datalen <= ETHERSIA_MAX_PACKET_SIZE) {
+        memcpy(txBatch[txBatchCount], data, datalen);
+        txBatchLength[txBatchCount] = datalen;
+        txBatchCount++;
+
+        if (txBatchCount == LINUXSOCKET_BATCH_SIZE) {
+            flushSendQueue();
+        }
+        return datalen;
+    }
+
     struct sockaddr_ll socket_address;
 
     /* Index of the network device */
@@ -129,24 +345,311 @@ EtherSia_LinuxSocket::sendFrame(const uint8_t *data, uint16_t datalen)
     return result;
 }
 
+void
+EtherSia_LinuxSocket::flushSendQueue()
+{
+    struct mmsghdr msgs[LINUXSOCKET_BATCH_SIZE];
+    struct iovec iovs[LINUXSOCKET_BATCH_SIZE];
+    struct sockaddr_ll addrs[LINUXSOCKET_BATCH_SIZE];
+
+    if (txBatchCount == 0) {
+        return;
+    }
+
+    memset(msgs, 0, sizeof(msgs));
+    memset(addrs, 0, sizeof(addrs));
+    for (uint8_t i = 0; i < txBatchCount; i++) {
+        IPv6Packet *packet = (IPv6Packet*)txBatch[i];
+        addrs[i].sll_ifindex = ifindex;
+        addrs[i].sll_halen = ETH_ALEN;
+        memcpy(&addrs[i].sll_addr, packet->etherDestination(), 6);
+
+        iovs[i].iov_base = txBatch[i];
+        iovs[i].iov_len = txBatchLength[i];
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_ll);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* sendmmsg() stops at the first frame that fails - drop it and carry on */
+    uint8_t sent = 0;
+    while (sent < txBatchCount) {
+        int result = sendmmsg(sockfd, &msgs[sent], txBatchCount - sent, 0);
+        if (result <= 0) {
+            perror("sendmmsg");
+            result = 1;
+        }
+        sent += result;
+    }
+
+    txBatchCount = 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+uint16_t
+EtherSia_LinuxSocket::sendRingFrame(const uint8_t *data, uint16_t datalen)
+{
+#ifdef TPACKET3_HDRLEN
+    const uint16_t offset = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+    struct tpacket3_hdr *hdr = (struct tpacket3_hdr*)(txRing + (txFrame * LINUXSOCKET_RING_FRAME_SIZE));
+
+    if (datalen > LINUXSOCKET_RING_FRAME_SIZE - offset) {
+        fprintf(stderr, "Frame is too big for PACKET_TX_RING\n");
+        return 0;
+    }
+
+    /* The kernel hasn't caught up yet - wait for it to send what is already in the ring */
+    for (uint8_t attempt = 0; hdr->tp_status & (TP_STATUS_SEND_REQUEST | TP_STATUS_SENDING); attempt++) {
+        if (attempt == 10) {
+            fprintf(stderr, "Timed out waiting for PACKET_TX_RING\n");
+            return 0;
+        }
+
+        if (::send(sockfd, NULL, 0, 0) == -1 && errno != EINTR) {
+            perror("send(PACKET_TX_RING)");
+            return 0;
+        }
+        __sync_synchronize();
+    }
+
+    memcpy((uint8_t*)hdr + offset, data, datalen);
+    hdr->tp_len = datalen;
+    hdr->tp_next_offset = 0;
+    __sync_synchronize();
+    hdr->tp_status = TP_STATUS_SEND_REQUEST;
+
+    txFrame = (txFrame + 1) % txFrameCount;
+
+    /* Ask the kernel to transmit everything that is waiting in the ring */
+    if (::send(sockfd, NULL, 0, MSG_DONTWAIT) == -1 && errno != EAGAIN) {
+        perror("send(PACKET_TX_RING)");
+    }
+
+    return datalen;
+#else
+    (void)data;
+    (void)datalen;
+    return 0;
+#endif
+}
+
+/*---------------------------------------------------------------------------*/
+
+uint16_t
+EtherSia_LinuxSocket::readRingFrame(uint8_t *buffer, uint16_t bufsize)
+{
+#ifdef TPACKET3_HDRLEN
+    while (true) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc*)(rxRing + (rxBlock * LINUXSOCKET_RING_BLOCK_SIZE));
+
+        if (rxFrame == NULL) {
+            /* Wait for the kernel to hand over the next block */
+            if ((block->hdr.bh1.block_status & TP_STATUS_USER) == 0) {
+                return 0;
+            }
+
+            __sync_synchronize();
+            rxFrame = (uint8_t*)block + block->hdr.bh1.offset_to_first_pkt;
+            rxFramesLeft = block->hdr.bh1.num_pkts;
+        }
+
+        uint16_t length = 0;
+        if (rxFramesLeft > 0) {
+            struct tpacket3_hdr *hdr = (struct tpacket3_hdr*)rxFrame;
+
+            /* Frames that don't fit in the buffer are skipped */
+            if (hdr->tp_snaplen <= bufsize) {
+                length = hdr->tp_snaplen;
+                memcpy(buffer, rxFrame + hdr->tp_mac, length);
+
+#ifdef TP_STATUS_CSUM_VALID
+                /* Check if the network card or kernel has already verified the checksum */
+                if (hdr->tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) {
+                    _frameChecksumValid = true;
+                }
+#endif
+            }
+
+            rxFrame += hdr->tp_next_offset;
+            rxFramesLeft--;
+        }
+
+        if (rxFramesLeft == 0) {
+            /* Give the block back to the kernel */
+            __sync_synchronize();
+            block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+            rxBlock = (rxBlock + 1) % LINUXSOCKET_RING_BLOCK_COUNT;
+            rxFrame = NULL;
+        }
+
+        if (length) {
+            return length;
+        }
+    }
+#else
+    (void)buffer;
+    (void)bufsize;
+    return 0;
+#endif
+}
+
 /*---------------------------------------------------------------------------*/
 
 uint16_t
 EtherSia_LinuxSocket::readFrame(uint8_t *buffer, uint16_t bufsize)
 {
-    int result = read(sockfd, buffer, bufsize);
+    /* Send anything that is waiting, before replies to this frame are queued */
+    if (txBatchCount) {
+        flushSendQueue();
+    }
+
+    updateFilter();
+
+    if (rxRing) {
+        return readRingFrame(buffer, bufsize);
+    }
+
+    while (true) {
+        if (rxBatchNext < rxBatchCount) {
+            uint8_t i = rxBatchNext++;
+
+            /* Frames that don't fit in the buffer are skipped */
+            if (rxBatchLength[i] == 0 || rxBatchLength[i] > bufsize) {
+                continue;
+            }
+
+            memcpy(buffer, rxBatch[i], rxBatchLength[i]);
+            if (rxBatchChecksumValid[i]) {
+                _frameChecksumValid = true;
+            }
+            return rxBatchLength[i];
+        }
+
+        /* The last batch didn't fill up, so the socket was empty - don't ask again straight away */
+        if (rxDrained) {
+            rxDrained = false;
+            return 0;
+        }
+
+        if (readBatch() == 0) {
+            return 0;
+        }
+    }
+}
+
+uint8_t
+EtherSia_LinuxSocket::readBatch()
+{
+    struct mmsghdr msgs[LINUXSOCKET_BATCH_SIZE];
+    struct iovec iovs[LINUXSOCKET_BATCH_SIZE];
+    union {
+        struct cmsghdr cmsg;
+        char buf[CMSG_SPACE(sizeof(struct tpacket_auxdata))];
+    } control[LINUXSOCKET_BATCH_SIZE];
+
+    memset(msgs, 0, sizeof(msgs));
+    for (uint8_t i = 0; i < LINUXSOCKET_BATCH_SIZE; i++) {
+        iovs[i].iov_base = rxBatch[i];
+        iovs[i].iov_len = ETHERSIA_MAX_PACKET_SIZE;
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = &control[i];
+        msgs[i].msg_hdr.msg_controllen = sizeof(control[i]);
+    }
+
+    rxBatchCount = 0;
+    rxBatchNext = 0;
+
+    int result = recvmmsg(sockfd, msgs, LINUXSOCKET_BATCH_SIZE, 0, NULL);
     if (result <= 0) {
         if (errno != EAGAIN)
             perror("Failed to read");
         return 0;
     }
 
+    for (int i = 0; i < result; i++) {
+        struct msghdr *msg = &msgs[i].msg_hdr;
+        rxBatchLength[i] = (msg->msg_flags & MSG_TRUNC) ? 0 : msgs[i].msg_len;
+        rxBatchChecksumValid[i] = false;
+
+#ifdef TP_STATUS_CSUM_VALID
+        /* Check if the network card or kernel has already verified the checksum */
+        for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg; cmsg = CMSG_NXTHDR(msg, cmsg)) {
+            if (cmsg->cmsg_level == SOL_PACKET && cmsg->cmsg_type == PACKET_AUXDATA) {
+                struct tpacket_auxdata aux;
+                memcpy(&aux, CMSG_DATA(cmsg), sizeof(aux));
+                if (aux.tp_status & (TP_STATUS_CSUM_VALID | TP_STATUS_CSUMNOTREADY)) {
+                    rxBatchChecksumValid[i] = true;
+                }
+            }
+        }
+#endif
+    }
+
+    rxBatchCount = result;
+    rxDrained = (result < LINUXSOCKET_BATCH_SIZE);
+
     return result;
 }
 
+boolean
+EtherSia_LinuxSocket::waitForFrame(uint16_t timeout)
+{
+    /* Don't sleep on frames that are still waiting to be sent */
+    if (txBatchCount) {
+        flushSendQueue();
+    }
+
+    updateFilter();
+
+    if (rxBatchNext < rxBatchCount || rxFrame != NULL) {
+        return true;
+    }
+
+#ifdef TPACKET3_HDRLEN
+    if (rxRing) {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc*)(rxRing + (rxBlock * LINUXSOCKET_RING_BLOCK_SIZE));
+        if (block->hdr.bh1.block_status & TP_STATUS_USER) {
+            return true;
+        }
+    }
+#endif
+
+    struct pollfd pfd;
+    pfd.fd = sockfd;
+    pfd.events = POLLIN | POLLERR;
+    pfd.revents = 0;
+
+    int result = poll(&pfd, 1, timeout);
+    if (result < 0) {
+        if (errno != EINTR)
+            perror("poll");
+        return false;
+    }
+
+    /* poll() has just checked the socket, so read it even if the last batch came back short */
+    rxDrained = false;
+
+    return result > 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
 void
 EtherSia_LinuxSocket::end()
 {
+    flushSendQueue();
+
+    if (ring) {
+        munmap(ring, ringSize);
+        ring = NULL;
+        rxRing = NULL;
+        txRing = NULL;
+        txFrameCount = 0;
+    }
+
     if (sockfd > 0) {
         close(sockfd);
         sockfd = -1;
@@ -10,6 +10,44 @@
 
 #include "EtherSia.h"
 
+/**
+ * The size of each block in the memory-mapped receive and transmit rings
+ * Must be a multiple of the system page size.
+ */
+#ifndef LINUXSOCKET_RING_BLOCK_SIZE
+#define LINUXSOCKET_RING_BLOCK_SIZE    (1 << 16)
+#endif
+
+/**
+ * The number of blocks in each of the memory-mapped rings
+ */
+#ifndef LINUXSOCKET_RING_BLOCK_COUNT
+#define LINUXSOCKET_RING_BLOCK_COUNT   (16)
+#endif
+
+/**
+ * The size of each frame slot in the memory-mapped transmit ring
+ */
+#ifndef LINUXSOCKET_RING_FRAME_SIZE
+#define LINUXSOCKET_RING_FRAME_SIZE    (2048)
+#endif
+
+/**
+ * How long (in milliseconds) the kernel waits before handing over
+ * a partially filled receive block
+ */
+#ifndef LINUXSOCKET_RING_BLOCK_TIMEOUT
+#define LINUXSOCKET_RING_BLOCK_TIMEOUT (10)
+#endif
+
+/**
+ * The number of frames fetched with a single recvmmsg() call,
+ * and the number of outgoing frames sent with a single sendmmsg() call
+ */
+#ifndef LINUXSOCKET_BATCH_SIZE
+#define LINUXSOCKET_BATCH_SIZE         (8)
+#endif
+
 /**
  * Run EtherSia on Linux using a raw socket to Send and receive Ethernet frames
  * Not intended for use with running EtherSia on Arduino.
@@ -25,6 +63,51 @@ public:
      */
     EtherSia_LinuxSocket(const char* iface = NULL);
 
+    /**
+     * Use PACKET_MMAP (TPACKET_V3) rings shared with the kernel
+     * to receive and transmit frames, instead of a system call per frame.
+     * Must be called before begin(). If the kernel does not support
+     * the rings, the driver falls back to recvmsg() and sendto().
+     */
+    void enableRings() {
+        useRings = true;
+    }
+
+    /**
+     * Put the network interface into promiscuous mode in begin()
+     *
+     * This is the default, so that EtherSia can use a MAC address that is
+     * different to the one belonging to the interface.
+     */
+    void enablePromiscuous() {
+        promiscuous = true;
+    }
+
+    /**
+     * Don't put the network interface into promiscuous mode in begin()
+     *
+     * Instead, the interface is asked to accept frames sent to our MAC address
+     * and all IPv6 multicast frames. Must be called before begin().
+     */
+    void disablePromiscuous() {
+        promiscuous = false;
+    }
+
+    /**
+     * Hold outgoing frames and send them in batches with sendmmsg()
+     *
+     * Queued frames are sent when the batch is full, the next time a frame
+     * is read, when flushSendQueue() is called, or when end() is called.
+     */
+    void enableSendBatching() {
+        batchSends = true;
+    }
+
+    /**
+     * Send any frames that are being held by enableSendBatching()
+     */
+    void flushSendQueue();
+
     // Tell the compiler we want to use begin() from the base class
     using EtherSia::begin;
 
@@ -54,6 +137,13 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
 
+    /**
+     * Sleep until a frame arrives on the socket, using poll()
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return false if the timeout expired without a frame arriving
+     */
+    virtual boolean waitForFrame(uint16_t timeout);
+
     /**
      * Close the raw ethernet socket
      */
@@ -61,9 +151,84 @@ public:
 
 protected:
 
+    /**
+     * Attach a BPF program to the socket, so that the kernel drops frames
+     * that checkEthernetAddresses() would reject, before they are copied
+     * to user space.
+     *
+     * It is generated from our MAC address, and the all-nodes and
+     * solicited-node multicast addresses of our IPv6 addresses.
+     */
+    void attachFilter();
+
+    /**
+     * Re-attach the BPF program if our IPv6 addresses have changed
+     */
+    void updateFilter();
+
+    /**
+     * Set up the memory-mapped receive and transmit rings
+     * @return true if at least the receive ring was set up
+     */
+    boolean setupRings();
+
+    /**
+     * Copy the next frame out of the memory-mapped receive ring
+     * @param buffer a pointer to a buffer to write the packet to
+     * @param bufsize the available space in the buffer
+     * @return the length of the received packet
+     *         or 0 if the kernel has not handed over any more frames
+     */
+    uint16_t readRingFrame(uint8_t *buffer, uint16_t bufsize);
+
+    /**
+     * Queue a frame in the memory-mapped transmit ring
+     *
+     * If the next slot in the ring is still in use, this waits for
+     * the kernel to send the frames that are already in the ring.
+     *
+     * @param data a pointer to the data to send
+     * @param datalen the length of the data in the packet
+     * @return the number of bytes queued, or 0 if the frame couldn't be queued
+     */
+    uint16_t sendRingFrame(const uint8_t *data, uint16_t datalen);
+
+    /**
+     * Fetch up to LINUXSOCKET_BATCH_SIZE frames from the socket with recvmmsg()
+     * @return the number of frames fetched
+     */
+    uint8_t readBatch();
+
     char ifname[IFNAMSIZ];
     int ifindex;
     int sockfd;
+
+    boolean promiscuous;
+    IPv6Address filterLinkLocal;
+    IPv6Address filterGlobal;
+
+    boolean useRings;
+    uint8_t *ring;
+    size_t ringSize;
+    uint8_t *rxRing;
+    uint8_t *rxFrame;
+    uint32_t rxFramesLeft;
+    uint16_t rxBlock;
+    uint8_t *txRing;
+    uint32_t txFrameCount;
+    uint32_t txFrame;
+
+    uint8_t rxBatch[LINUXSOCKET_BATCH_SIZE][ETHERSIA_MAX_PACKET_SIZE];
+    uint16_t rxBatchLength[LINUXSOCKET_BATCH_SIZE];
+    boolean rxBatchChecksumValid[LINUXSOCKET_BATCH_SIZE];
+    uint8_t rxBatchCount;
+    uint8_t rxBatchNext;
+    boolean rxDrained;
+
+    boolean batchSends;
+    uint8_t txBatch[LINUXSOCKET_BATCH_SIZE][ETHERSIA_MAX_PACKET_SIZE];
+    uint16_t txBatchLength[LINUXSOCKET_BATCH_SIZE];
+    uint8_t txBatchCount;
 };
 
 #endif /* LINUXSOCKET_H */
@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2016, Nicholas Humfrey
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#if !defined(ARDUINO) && defined(__linux__)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <net/if.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+
+
+#include "LinuxXDP.h"
+
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+
+static int bpf(enum bpf_cmd cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+
+EtherSia_LinuxXDP::EtherSia_LinuxXDP(const char* ifname)
+{
+    strncpy(this->ifname, ifname, sizeof(this->ifname)-1);
+    ifindex = -1;
+    xskfd = -1;
+    mapfd = -1;
+    progfd = -1;
+    linkfd = -1;
+    umem = NULL;
+    memset(&rx, 0, sizeof(rx));
+    memset(&tx, 0, sizeof(tx));
+    memset(&fill, 0, sizeof(fill));
+    memset(&completion, 0, sizeof(completion));
+    txFreeCount = 0;
+}
+
+
+boolean
+EtherSia_LinuxXDP::begin(const MACAddress &address)
+{
+    _localMac = address;
+
+    ifindex = if_nametoindex(ifname);
+    if (ifindex <= 0) {
+        perror("if_nametoindex");
+        return false;
+    }
+
+    if (!setupSocket() || !attachProgram()) {
+        end();
+        return false;
+    }
+
+    return EtherSia::begin();
+}
+
+boolean
+EtherSia_LinuxXDP::setupSocket()
+{
+    const size_t umemSize = LINUXXDP_FRAME_COUNT * LINUXXDP_FRAME_SIZE;
+    void *mapped = mmap(NULL, umemSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        perror("mmap(UMEM)");
+        return false;
+    }
+    umem = (uint8_t*)mapped;
+
+    if ((xskfd = socket(AF_XDP, SOCK_RAW, 0)) == -1) {
+        perror("socket(AF_XDP)");
+        return false;
+    }
+
+    /* Register the UMEM, which holds the frames shared with the kernel */
+    struct xdp_umem_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.addr = (uint64_t)(uintptr_t)umem;
+    reg.len = umemSize;
+    reg.chunk_size = LINUXXDP_FRAME_SIZE;
+    reg.headroom = 0;
+    if (setsockopt(xskfd, SOL_XDP, XDP_UMEM_REG, &reg, sizeof reg) == -1) {
+        perror("setsockopt(XDP_UMEM_REG)");
+        return false;
+    }
+
+    int size = LINUXXDP_RING_SIZE;
+    if (setsockopt(xskfd, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof size) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof size) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_RX_RING, &size, sizeof size) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_TX_RING, &size, sizeof size) == -1) {
+        perror("setsockopt(XDP rings)");
+        return false;
+    }
+
+    struct xdp_mmap_offsets offsets;
+    socklen_t optlen = sizeof(offsets);
+    if (getsockopt(xskfd, SOL_XDP, XDP_MMAP_OFFSETS, &offsets, &optlen) == -1) {
+        perror("getsockopt(XDP_MMAP_OFFSETS)");
+        return false;
+    }
+
+    if (!mapQueue(&rx, &offsets.rx, sizeof(struct xdp_desc), XDP_PGOFF_RX_RING) ||
+            !mapQueue(&tx, &offsets.tx, sizeof(struct xdp_desc), XDP_PGOFF_TX_RING) ||
+            !mapQueue(&fill, &offsets.fr, sizeof(uint64_t), XDP_UMEM_PGOFF_FILL_RING) ||
+            !mapQueue(&completion, &offsets.cr, sizeof(uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING)) {
+        return false;
+    }
+
+    /* The first half of the frames are for receiving - hand them all to the kernel */
+    uint64_t *addrs = (uint64_t*)fill.entries;
+    for (uint32_t i = 0; i < LINUXXDP_FRAME_COUNT / 2; i++) {
+        addrs[i % LINUXXDP_RING_SIZE] = (uint64_t)i * LINUXXDP_FRAME_SIZE;
+    }
+    __atomic_store_n(fill.producer, LINUXXDP_FRAME_COUNT / 2, __ATOMIC_RELEASE);
+
+    /* The second half are for sending */
+    txFreeCount = 0;
+    for (uint32_t i = LINUXXDP_FRAME_COUNT / 2; i < LINUXXDP_FRAME_COUNT; i++) {
+        txFree[txFreeCount++] = (uint64_t)i * LINUXXDP_FRAME_SIZE;
+    }
+
+    /* Copy mode works on any interface, including veth */
+    struct sockaddr_xdp sxdp;
+    memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = ifindex;
+    sxdp.sxdp_queue_id = 0;
+    sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+    if (bind(xskfd, (struct sockaddr*)&sxdp, sizeof(sxdp)) == -1) {
+        perror("bind(AF_XDP)");
+        return false;
+    }
+
+    return true;
+}
+
+boolean
+EtherSia_LinuxXDP::mapQueue(struct xdp_queue *queue, const struct xdp_ring_offset *offsets, size_t entrySize, off_t pgoff)
+{
+    queue->mapSize = offsets->desc + (LINUXXDP_RING_SIZE * entrySize);
+    void *mapped = mmap(NULL, queue->mapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xskfd, pgoff);
+    if (mapped == MAP_FAILED) {
+        perror("mmap(AF_XDP ring)");
+        queue->map = NULL;
+        return false;
+    }
+
+    uint8_t *base = (uint8_t*)mapped;
+    queue->map = mapped;
+    queue->producer = (uint32_t*)(base + offsets->producer);
+    queue->consumer = (uint32_t*)(base + offsets->consumer);
+    queue->flags = (uint32_t*)(base + offsets->flags);
+    queue->entries = base + offsets->desc;
+    return true;
+}
+
+boolean
+EtherSia_LinuxXDP::attachProgram()
+{
+    union bpf_attr attr;
+
+    /* Map from receive queue number to AF_XDP socket */
+    memset(&attr, 0, sizeof(attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint32_t);
+    attr.max_entries = 1;
+    if ((mapfd = bpf(BPF_MAP_CREATE, &attr)) == -1) {
+        perror("bpf(BPF_MAP_CREATE)");
+        return false;
+    }
+
+    uint32_t key = 0;
+    uint32_t value = xskfd;
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = mapfd;
+    attr.key = (uint64_t)(uintptr_t)&key;
+    attr.value = (uint64_t)(uintptr_t)&value;
+    if (bpf(BPF_MAP_UPDATE_ELEM, &attr) == -1) {
+        perror("bpf(BPF_MAP_UPDATE_ELEM)");
+        return false;
+    }
+
+    /*
+     * if (data + 14 > data_end || eth->h_proto != htons(ETH_P_IPV6))
+     *     return XDP_PASS;
+     * return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS);
+     */
+    struct bpf_insn program[] = {
+        { BPF_ALU64 | BPF_MOV | BPF_X,  6, 1, 0, 0 },
+        { BPF_LDX | BPF_MEM | BPF_W,    2, 6, 0, 0 },
+        { BPF_LDX | BPF_MEM | BPF_W,    3, 6, 4, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_X,  4, 2, 0, 0 },
+        { BPF_ALU64 | BPF_ADD | BPF_K,  4, 0, 0, 14 },
+        { BPF_JMP | BPF_JGT | BPF_X,    4, 3, 8, 0 },
+        { BPF_LDX | BPF_MEM | BPF_H,    4, 2, 12, 0 },
+        { BPF_JMP | BPF_JNE | BPF_K,    4, 0, 6, htons(ETHER_TYPE_IPV6) },
+        { BPF_LDX | BPF_MEM | BPF_W,    2, 6, 16, 0 },
+        { BPF_LD | BPF_DW | BPF_IMM,    1, BPF_PSEUDO_MAP_FD, 0, mapfd },
+        { 0,                            0, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_K,  3, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_CALL,           0, 0, 0, BPF_FUNC_redirect_map },
+        { BPF_JMP | BPF_EXIT,           0, 0, 0, 0 },
+        { BPF_ALU64 | BPF_MOV | BPF_K,  0, 0, 0, XDP_PASS },
+        { BPF_JMP | BPF_EXIT,           0, 0, 0, 0 }
+    };
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uint64_t)(uintptr_t)program;
+    attr.insn_cnt = sizeof(program) / sizeof(program[0]);
+    attr.license = (uint64_t)(uintptr_t)"Dual BSD/GPL";
+    attr.expected_attach_type = BPF_XDP;
+    if ((progfd = bpf(BPF_PROG_LOAD, &attr)) == -1) {
+        perror("bpf(BPF_PROG_LOAD)");
+        return false;
+    }
+
+    /* The program is detached again when the link is closed */
+    memset(&attr, 0, sizeof(attr));
+    attr.link_create.prog_fd = progfd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+    if ((linkfd = bpf(BPF_LINK_CREATE, &attr)) == -1) {
+        perror("bpf(BPF_LINK_CREATE)");
+        return false;
+    }
+
+    return true;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void
+EtherSia_LinuxXDP::wakeup(struct xdp_queue *queue)
+{
+    if (__atomic_load_n(queue->flags, __ATOMIC_ACQUIRE) & XDP_RING_NEED_WAKEUP) {
+        if (sendto(xskfd, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1 &&
+                errno != EAGAIN && errno != EBUSY && errno != ENOBUFS) {
+            perror("sendto(AF_XDP)");
+        }
+    }
+}
+
+void
+EtherSia_LinuxXDP::reclaimTxFrames()
+{
+    uint32_t producer = __atomic_load_n(completion.producer, __ATOMIC_ACQUIRE);
+    uint32_t consumer = *completion.consumer;
+    uint64_t *addrs = (uint64_t*)completion.entries;
+
+    while (consumer != producer) {
+        txFree[txFreeCount++] = addrs[consumer % LINUXXDP_RING_SIZE];
+        consumer++;
+    }
+
+    __atomic_store_n(completion.consumer, consumer, __ATOMIC_RELEASE);
+}
+
+uint16_t
+EtherSia_LinuxXDP::sendFrame(const uint8_t *data, uint16_t datalen)
+{
+    if (datalen > LINUXXDP_FRAME_SIZE) {
+        return 0;
+    }
+
+    reclaimTxFrames();
+    if (txFreeCount == 0) {
+        /* Every frame is waiting to be sent - give the kernel a nudge */
+        wakeup(&tx);
+        reclaimTxFrames();
+        if (txFreeCount == 0) {
+            return 0;
+        }
+    }
+
+    uint64_t addr = txFree[--txFreeCount];
+    memcpy(umem + addr, data, datalen);
+
+    uint32_t producer = *tx.producer;
+    struct xdp_desc *desc = &((struct xdp_desc*)tx.entries)[producer % LINUXXDP_RING_SIZE];
+    desc->addr = addr;
+    desc->len = datalen;
+    desc->options = 0;
+    __atomic_store_n(tx.producer, producer + 1, __ATOMIC_RELEASE);
+
+    wakeup(&tx);
+
+    return datalen;
+}
+
+/*---------------------------------------------------------------------------*/
+
+uint8_t*
+EtherSia_LinuxXDP::lendFrame(uint16_t *length)
+{
+    while (true) {
+        uint32_t producer = __atomic_load_n(rx.producer, __ATOMIC_ACQUIRE);
+        uint32_t consumer = *rx.consumer;
+        if (producer == consumer) {
+            wakeup(&fill);
+            return NULL;
+        }
+
+        struct xdp_desc *desc = &((struct xdp_desc*)rx.entries)[consumer % LINUXXDP_RING_SIZE];
+        uint8_t *frame = umem + desc->addr;
+        uint32_t len = desc->len;
+        __atomic_store_n(rx.consumer, consumer + 1, __ATOMIC_RELEASE);
+
+        /* Frames that don't fit in the packet buffer are skipped */
+        if (len > ETHERSIA_MAX_PACKET_SIZE) {
+            returnFrame(frame);
+            continue;
+        }
+
+        *length = len;
+        return frame;
+    }
+}
+
+void
+EtherSia_LinuxXDP::returnFrame(uint8_t *frame)
+{
+    uint64_t addr = (uint64_t)(frame - umem) & ~((uint64_t)LINUXXDP_FRAME_SIZE - 1);
+
+    /* There are only as many receive frames as places in the fill ring */
+    uint32_t producer = *fill.producer;
+    ((uint64_t*)fill.entries)[producer % LINUXXDP_RING_SIZE] = addr;
+    __atomic_store_n(fill.producer, producer + 1, __ATOMIC_RELEASE);
+}
+
+uint16_t
+EtherSia_LinuxXDP::readFrame(uint8_t *buffer, uint16_t bufsize)
+{
+    uint16_t length;
+    uint8_t *frame;
+
+    while ((frame = lendFrame(&length)) != NULL) {
+        if (length <= bufsize) {
+            memcpy(buffer, frame, length);
+            returnFrame(frame);
+            return length;
+        }
+
+        returnFrame(frame);
+    }
+
+    return 0;
+}
+
+boolean
+EtherSia_LinuxXDP::waitForFrame(uint16_t timeout)
+{
+    if (__atomic_load_n(rx.producer, __ATOMIC_ACQUIRE) != *rx.consumer) {
+        return true;
+    }
+
+    struct pollfd pfd;
+    pfd.fd = xskfd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+
+    int result = poll(&pfd, 1, timeout);
+    if (result < 0) {
+        if (errno != EINTR)
+            perror("poll");
+        return false;
+    }
+
+    return result > 0;
+}
+
+/*---------------------------------------------------------------------------*/
+
+void
+EtherSia_LinuxXDP::end()
+{
+    if (linkfd >= 0) {
+        close(linkfd);
+        linkfd = -1;
+    }
+
+    if (progfd >= 0) {
+        close(progfd);
+        progfd = -1;
+    }
+
+    if (mapfd >= 0) {
+        close(mapfd);
+        mapfd = -1;
+    }
+
+    struct xdp_queue *queues[] = { &rx, &tx, &fill, &completion };
+    for (uint8_t i = 0; i < 4; i++) {
+        if (queues[i]->map) {
+            munmap(queues[i]->map, queues[i]->mapSize);
+        }
+        memset(queues[i], 0, sizeof(struct xdp_queue));
+    }
+
+    if (xskfd >= 0) {
+        close(xskfd);
+        xskfd = -1;
+    }
+
+    if (umem) {
+        munmap(umem, LINUXXDP_FRAME_COUNT * LINUXXDP_FRAME_SIZE);
+        umem = NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,181 @@
+/**
+ * Header file for using EtherSia with an AF_XDP socket on Linux
+ * @file LinuxXDP.h
+ */
+
+#ifndef LINUXXDP_H
+#define LINUXXDP_H
+
+#include <net/if.h>
+
+#include "EtherSia.h"
+
+struct xdp_ring_offset;
+
+/**
+ * The number of frames in the UMEM shared with the kernel
+ * Half are used for receiving and half for sending.
+ */
+#ifndef LINUXXDP_FRAME_COUNT
+#define LINUXXDP_FRAME_COUNT  (1024)
+#endif
+
+/**
+ * The size of each frame in the UMEM
+ * Must be a power of two, between 2048 and the system page size.
+ */
+#ifndef LINUXXDP_FRAME_SIZE
+#define LINUXXDP_FRAME_SIZE   (2048)
+#endif
+
+/**
+ * The number of entries in each of the AF_XDP rings
+ * Must be a power of two.
+ */
+#ifndef LINUXXDP_RING_SIZE
+#define LINUXXDP_RING_SIZE    (LINUXXDP_FRAME_COUNT / 2)
+#endif
+
+/**
+ * Pointers into one of the rings shared with the kernel
+ * @private
+ */
+struct xdp_queue {
+    uint32_t *producer;
+    uint32_t *consumer;
+    uint32_t *flags;
+    void *entries;
+    void *map;
+    size_t mapSize;
+};
+
+/**
+ * Run EtherSia on Linux using an AF_XDP socket to send and receive Ethernet frames
+ * Not intended for use with running EtherSia on Arduino.
+ *
+ * A small XDP program is attached to the interface, which redirects every
+ * IPv6 frame arriving on queue 0 to the socket; the kernel doesn't see them.
+ * Other frames are passed on as normal. It is intended for load-testing
+ * on a veth pair, where copy mode works without any special hardware.
+ *
+ * Received frames are lent to EtherSia's receive ring, so the packet buffer
+ * points straight into the memory shared with the kernel.
+ *
+ * @note must be run as root (or with CAP_NET_ADMIN and CAP_BPF)
+ */
+class EtherSia_LinuxXDP : public EtherSia {
+
+public:
+    /**
+     * Constructor
+     * @param iface the name of the Ethernet interface to send/receive on
+     */
+    EtherSia_LinuxXDP(const char* iface = NULL);
+
+    // Tell the compiler we want to use begin() from the base class
+    using EtherSia::begin;
+
+    /**
+     * Initialise the Ethernet controller
+     * Must be called before sending or receiving Ethernet frames
+     *
+     * @param address the local MAC address for the Ethernet interface
+     * @return Returns true if setting up the Ethernet interface was successful
+     */
+    virtual boolean begin(const MACAddress &address);
+
+    /**
+     * Send an Ethernet frame
+     * @param data a pointer to the data to send
+     * @param datalen the length of the data in the packet
+     * @return the number of bytes transmitted
+     */
+    virtual uint16_t sendFrame(const uint8_t *data, uint16_t datalen);
+
+    /**
+     * Read an Ethernet frame
+     * @param buffer a pointer to a buffer to write the packet to
+     * @param bufsize the available space in the buffer
+     * @return the length of the received packet
+     *         or 0 if no packet was received
+     */
+    virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
+
+    /**
+     * Sleep until a frame arrives on the socket, using poll()
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return false if the timeout expired without a frame arriving
+     */
+    virtual boolean waitForFrame(uint16_t timeout);
+
+    /**
+     * Lend the next received frame in the UMEM to EtherSia
+     * @param length Set to the length of the frame
+     * @return A pointer to the frame, or NULL if no frame has been received
+     */
+    virtual uint8_t* lendFrame(uint16_t *length);
+
+    /**
+     * Put a lent frame back on the fill ring, for the kernel to re-use
+     * @param frame The pointer that lendFrame() returned
+     */
+    virtual void returnFrame(uint8_t *frame);
+
+    /**
+     * Detach the XDP program and close the AF_XDP socket
+     */
+    virtual void end();
+
+protected:
+
+    /**
+     * Create the UMEM and AF_XDP socket, and map its rings
+     * @return true if successful
+     */
+    boolean setupSocket();
+
+    /**
+     * Load the XDP program and attach it to the interface
+     * @return true if successful
+     */
+    boolean attachProgram();
+
+    /**
+     * Map one of the AF_XDP rings into memory
+     * @param queue the structure to store pointers into the ring in
+     * @param offsets the offsets of the ring's fields, from XDP_MMAP_OFFSETS
+     * @param entrySize the size of each entry in the ring
+     * @param pgoff the mmap() offset that selects the ring
+     * @return true if successful
+     */
+    boolean mapQueue(struct xdp_queue *queue, const struct xdp_ring_offset *offsets, size_t entrySize, off_t pgoff);
+
+    /**
+     * Move the frames that the kernel has finished sending back to the free list
+     */
+    void reclaimTxFrames();
+
+    /**
+     * Wake up the kernel if it is waiting for us to notice a ring
+     * @param queue the ring to check
+     */
+    void wakeup(struct xdp_queue *queue);
+
+    char ifname[IFNAMSIZ];
+    int ifindex;
+    int xskfd;
+    int mapfd;
+    int progfd;
+    int linkfd;
+
+    uint8_t *umem;
+    struct xdp_queue rx;
+    struct xdp_queue tx;
+    struct xdp_queue fill;
+    struct xdp_queue completion;
+
+    uint64_t txFree[LINUXXDP_FRAME_COUNT / 2];
+    uint16_t txFreeCount;
+};
+
+#endif /* LINUXXDP_H */
@@ -58,6 +58,21 @@ void MACAddress::setIPv6Multicast(const uint8_t *address)
     _address[5] = address[15];
 }
 
+void MACAddress::setZero()
+{
+    memset(_address, 0, sizeof(_address));
+}
+
+boolean MACAddress::isZero() const
+{
+    for(uint8_t i=0; i < 6; i++) {
+        if (_address[i] != 0x00)
+            return 0;
+    }
+
+    return 1;
+}
+
 boolean MACAddress::isIPv6Multicast()
 {
     return _address[0] == 0x33 && _address[1] == 0x33;
@@ -84,6 +84,17 @@ public:
      */
     boolean operator!=(const MACAddress& address) const;
 
+    /**
+     * Set the MAC address to all-zeros (00:00:00:00:00:00)
+     */
+    void setZero();
+
+    /**
+     * Check if the MAC address is all-zeros (00:00:00:00:00:00)
+     * @return true if the address is all-zeros
+     */
+    boolean isZero() const;
+
     /**
      * Calculate the multicast MAC address for an IPv6 address.
      * @param address An IPv6 address as an array of 16-bytes
@@ -55,12 +55,22 @@ boolean Socket::setRemoteAddress(IPv6Address &remoteAddress, uint16_t remotePort
 
     // Work out the MAC address to use
     if (_ether.inOurSubnet(_remoteAddress)) {
+#if NEIGHBOUR_QUEUE_SIZE > 0
+        // Don't wait - packets are queued until discovery has completed
+        MACAddress *mac = _ether.resolveNeighbour(_remoteAddress);
+        if (mac == NULL) {
+            _remoteMac.setZero();
+        } else {
+            _remoteMac = *mac;
+        }
+#else
         MACAddress *mac = _ether.discoverNeighbour(_remoteAddress);
         if (mac == NULL) {
             return false;
         } else {
             _remoteMac = *mac;
         }
+#endif
     } else {
         _remoteMac = _ether.routerMac();
     }
@@ -123,6 +133,12 @@ void Socket::send(uint16_t length, boolean isReply)
     if (isReply) {
         _ether.prepareReply();
     } else {
+        // Pick up the latest MAC address from the Neighbour Cache
+        MACAddress *mac = _ether.lookupNeighbour(_remoteAddress);
+        if (mac) {
+            _remoteMac = *mac;
+        }
+
         packet.setDestination(_remoteAddress);
         packet.setEtherDestination(_remoteMac);
         _ether.prepareSend();
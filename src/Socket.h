@@ -59,6 +59,10 @@ public:
     /**
      * Set the remote address and port to send packets to
      *
+     * If the remote address is on the local subnet and isn't in the
+     * Neighbour Cache, Neighbour Discovery is started in the background and
+     * packets sent before it completes are queued (see NEIGHBOUR_QUEUE_SIZE).
+     *
      * @param remoteAddress The remote address as a 16-byte array
      * @param remotePort The remote port number to send packets to
      * @return true if the remote address was set successfully
@@ -0,0 +1,613 @@
+#include "EtherSia.h"
+#include "util.h"
+
+TCPClient::TCPClient(EtherSia &ether) : Socket(ether)
+{
+    _randomLocalPort = true;
+    _state = TCP_STATE_CLOSED;
+    _sendWindow = 0;
+    _sendUnacknowledged = 0;
+    _sendNext = 0;
+    _receiveNext = 0;
+    _ackPending = false;
+    _replyWaiting = false;
+    _messageStart = 0;
+    _segmentLimit = 0;
+    _rewriting = false;
+    _rewriteSkip = 0;
+    _rewritePos = 0;
+}
+
+TCPClient::TCPClient(EtherSia &ether, uint16_t localPort) : TCPClient(ether)
+{
+    _randomLocalPort = false;
+    _localPort = localPort;
+}
+
+boolean TCPClient::connect()
+{
+    if (_state != TCP_STATE_CLOSED) {
+        close();
+    }
+
+    if (_remotePort == 0) {
+        // setRemoteAddress() hasn't been called
+        return false;
+    }
+
+    if (_randomLocalPort) {
+        // Use a different port for each connection, so that segments
+        // from an old connection aren't mistaken for the new one
+        _localPort = random(20000, 30000);
+    }
+
+    // Initialise our sequence number to a random number
+    _sendUnacknowledged = random();
+    _sendNext = _sendUnacknowledged + 1;
+    _receiveNext = 0;
+    _sendWindow = 0;
+    _ackPending = false;
+    _replyWaiting = false;
+    _writePos = -1;
+    _state = TCP_STATE_SYN_SENT;
+
+    _ether.selectTransmitBuffer();
+    sendSegment(TCP_FLAG_SYN, _sendUnacknowledged, 0);
+
+    // The SYN-ACK is acknowledged by processSegment()
+    return waitForAck(false) && connected();
+}
+
+boolean TCPClient::connected()
+{
+    return _state == TCP_STATE_ESTABLISHED || _state == TCP_STATE_CLOSE_WAIT;
+}
+
+void TCPClient::close()
+{
+    if (_state == TCP_STATE_ESTABLISHED) {
+        _state = TCP_STATE_FIN_WAIT_1;
+    } else if (_state == TCP_STATE_CLOSE_WAIT) {
+        // The server has already closed its end
+        _state = TCP_STATE_LAST_ACK;
+    } else {
+        // Not connected, or already closing
+        _state = TCP_STATE_CLOSED;
+        return;
+    }
+
+    // Anything written but not sent is thrown away
+    _writePos = -1;
+    _ether.selectTransmitBuffer();
+    if (!sendData(TCP_FLAG_ACK | TCP_FLAG_FIN, 0, false)) {
+        return;
+    }
+
+    // Wait for the server to close its end too
+    uint32_t timeout = millis() + TCP_RECEIVE_TIMEOUT;
+    while (_state == TCP_STATE_FIN_WAIT_2) {
+        int32_t remaining = timeout - millis();
+        if (remaining <= 0) {
+            break;
+        }
+
+        _ether.waitForPacket(remaining);
+        if (_ether.receivePacket() && validSegment() && processSegment(true)) {
+            // Nobody wants any more data - acknowledge it and throw it away
+            _ether.selectTransmitBuffer();
+            sendAck();
+        }
+    }
+
+    // Don't wait in TIME-WAIT: the next connection uses a different port
+    _state = TCP_STATE_CLOSED;
+}
+
+boolean TCPClient::havePacket()
+{
+    IPv6Packet& packet = _ether.packet();
+
+    if (!_ether.bufferContainsReceived()) {
+        // The buffer is free, so acknowledge the data that has been handled
+        if (_ackPending && _writePos == -1) {
+            sendAck();
+        }
+        return false;
+    }
+
+    if (!validSegment()) {
+        return false;
+    }
+
+    // The flags of an accepted packet are cleared, so that
+    // calling havePacket() again doesn't process it twice
+    if (TCP_HEADER_PTR->flags == 0) {
+        _replyWaiting = false;
+        return true;
+    }
+
+    return processSegment(true);
+}
+
+boolean TCPClient::receive()
+{
+    IPv6Packet& packet = _ether.packet();
+    uint32_t timeout = millis() + TCP_RECEIVE_TIMEOUT;
+
+    if (_replyWaiting) {
+        // The reply arrived with the acknowledgement of the message sent
+        _replyWaiting = false;
+        if (_ether.bufferContainsReceived() && validSegment() && TCP_HEADER_PTR->flags == 0) {
+            return true;
+        }
+    }
+
+    if (_ackPending) {
+        _ether.selectTransmitBuffer();
+        sendAck();
+    }
+
+    // Wait while the server can still send data
+    while (_state == TCP_STATE_ESTABLISHED ||
+            _state == TCP_STATE_FIN_WAIT_1 ||
+            _state == TCP_STATE_FIN_WAIT_2) {
+        int32_t remaining = timeout - millis();
+        if (remaining <= 0) {
+            break;
+        }
+
+        _ether.waitForPacket(remaining);
+        if (_ether.receivePacket() && validSegment() && processSegment(true)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+boolean TCPClient::validSegment()
+{
+    IPv6Packet& packet = _ether.packet();
+
+    if (!_ether.bufferContainsReceived()) {
+        return false;
+    }
+
+    if (packet.protocol() != IP6_PROTO_TCP) {
+        // Wrong protocol
+        return false;
+    }
+
+    if (_state == TCP_STATE_CLOSED) {
+        // Not connected
+        return false;
+    }
+
+    if (packetDestinationPort() != _localPort || packetSourcePort() != _remotePort) {
+        // Wrong port numbers
+        return false;
+    }
+
+    if (packetSource() != _remoteAddress) {
+        // Wrong source address
+        return false;
+    }
+
+    if (!_ether.verifyChecksum()) {
+        // Packet is corrupt
+        return false;
+    }
+
+    return true;
+}
+
+boolean TCPClient::processSegment(boolean acceptData)
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_header *tcpHeader = TCP_HEADER_PTR;
+    uint32_t seq = ntohl(tcpHeader->sequenceNum);
+    uint32_t ack = ntohl(tcpHeader->acknowledgementNum);
+    uint16_t length = payloadLength();
+    uint8_t flags = tcpHeader->flags;
+
+    if (flags & TCP_FLAG_RST) {
+        // Only accept a reset that is for our SYN, or exactly in sequence (RFC5961)
+        if (_state == TCP_STATE_SYN_SENT) {
+            if ((flags & TCP_FLAG_ACK) && ack == _sendNext) {
+                _state = TCP_STATE_CLOSED;
+            }
+        } else if (seq == _receiveNext) {
+            _state = TCP_STATE_CLOSED;
+        }
+        return false;
+    }
+
+    if (_state == TCP_STATE_SYN_SENT) {
+        if ((flags & TCP_FLAG_SYN) && (flags & TCP_FLAG_ACK) && ack == _sendNext) {
+            // The server has accepted the connection
+            _sendUnacknowledged = ack;
+            _sendWindow = ntohs(tcpHeader->window);
+            _receiveNext = seq + 1;
+            _state = TCP_STATE_ESTABLISHED;
+            sendAck();
+        } else if ((flags & TCP_FLAG_ACK) && ack != _sendNext) {
+            // Left over from an old connection using the same port numbers - reset it
+            _ether.selectTransmitBuffer();
+            sendSegment(TCP_FLAG_RST, ack, 0);
+        }
+        return false;
+    }
+
+    if (flags & TCP_FLAG_SYN) {
+        // Our ACK of the SYN-ACK must have been lost - send it again
+        sendAck();
+        return false;
+    }
+
+    if (!(flags & TCP_FLAG_ACK)) {
+        // Every segment after the SYN should have the ACK flag set
+        return false;
+    }
+
+    if (TCP_SEQ_LE(_sendUnacknowledged, ack) && TCP_SEQ_LE(ack, _sendNext)) {
+        _sendUnacknowledged = ack;
+        _sendWindow = ntohs(tcpHeader->window);
+    }
+
+    if (_sendUnacknowledged == _sendNext) {
+        // Everything we have sent has been acknowledged
+        if (_state == TCP_STATE_FIN_WAIT_1) {
+            _state = TCP_STATE_FIN_WAIT_2;
+        } else if (_state == TCP_STATE_CLOSING) {
+            _state = TCP_STATE_TIME_WAIT;
+        } else if (_state == TCP_STATE_LAST_ACK) {
+            _state = TCP_STATE_CLOSED;
+            return false;
+        }
+    }
+
+    if (length == 0 && !(flags & TCP_FLAG_FIN)) {
+        // Nothing more to do for a segment that only acknowledges
+        return false;
+    }
+
+    if (seq != _receiveNext) {
+        // Duplicate or out of order - tell the server what we are expecting next
+        sendAck();
+        return false;
+    }
+
+    if (length > 0 && (!acceptData || _sendUnacknowledged != _sendNext)) {
+        // Can't handle data while sending - the server will send it again
+        return false;
+    }
+
+    _receiveNext += length;
+
+    if (flags & TCP_FLAG_FIN) {
+        _receiveNext++;
+        if (_state == TCP_STATE_ESTABLISHED) {
+            _state = TCP_STATE_CLOSE_WAIT;
+        } else if (_state == TCP_STATE_FIN_WAIT_1) {
+            _state = TCP_STATE_CLOSING;
+        } else if (_state == TCP_STATE_FIN_WAIT_2) {
+            _state = TCP_STATE_TIME_WAIT;
+        }
+    }
+
+    if (length > 0) {
+        // Packet contains data that needs to be handled
+        // (it is acknowledged afterwards)
+        _ackPending = true;
+        tcpHeader->flags = 0;
+        return true;
+    }
+
+    sendAck();
+    return false;
+}
+
+size_t TCPClient::write(uint8_t chr)
+{
+    if (_rewriting) {
+        // Only keep the bytes that are being re-sent
+        if (_rewriteSkip > 0) {
+            _rewriteSkip--;
+        } else if (_rewritePos < _segmentLimit) {
+            transmitPayload()[_rewritePos++] = chr;
+        }
+        return 1;
+    }
+
+    if (!connected()) {
+        return 0;
+    }
+
+    if (_writePos == -1) {
+        // Starting a new message
+        if (!waitForWindow()) {
+            return 0;
+        }
+        _ether.selectTransmitBuffer();
+        _messageStart = _sendNext;
+        _segmentLimit = segmentLimit();
+    } else if (_writePos >= _segmentLimit) {
+        // Send the segment that has been written so far, and start a new one
+        if (!sendData(TCP_FLAG_ACK | TCP_FLAG_PSH, _writePos, false)) {
+            _writePos = -1;
+            return 0;
+        }
+
+        if (!waitForWindow()) {
+            _writePos = -1;
+            return 0;
+        }
+
+        // The buffer may now contain a received packet
+        _ether.selectTransmitBuffer();
+        _writePos = 0;
+        _segmentLimit = segmentLimit();
+    }
+
+    return Socket::write(chr);
+}
+
+boolean TCPClient::rewriteMessage()
+{
+    return false;
+}
+
+void TCPClient::sendInternal(uint16_t length, boolean /*isReply*/)
+{
+    if (_rewriting) {
+        // The whole message was passed to send() - keep the part being re-sent
+        if (_rewritePos == 0 && length > _rewriteSkip) {
+            uint16_t keep = length - _rewriteSkip;
+            if (keep > _segmentLimit) {
+                keep = _segmentLimit;
+            }
+            memmove(transmitPayload(), transmitPayload() + _rewriteSkip, keep);
+            _rewritePos = keep;
+        }
+        return;
+    }
+
+    if (!connected()) {
+        return;
+    }
+
+    if (_writePos == -1) {
+        // The data wasn't written with write()
+        _messageStart = _sendNext;
+    }
+
+    // The end of the message - the reply may arrive with the acknowledgement
+    sendData(TCP_FLAG_ACK | TCP_FLAG_PSH, length, true);
+}
+
+boolean TCPClient::sendData(uint8_t flags, uint16_t length, boolean acceptReply)
+{
+    sendSegment(flags, _sendNext, length);
+    _sendNext += length + ((flags & TCP_FLAG_FIN) ? 1 : 0);
+
+    return waitForAck(acceptReply);
+}
+
+boolean TCPClient::waitForAck(boolean acceptReply)
+{
+    uint16_t rto = TCP_INITIAL_RTO;
+    uint8_t retransmissions = 0;
+    uint32_t sendTime = millis();
+
+    while (_sendUnacknowledged != _sendNext) {
+        if (_state == TCP_STATE_CLOSED) {
+            // The server reset the connection
+            return false;
+        }
+
+        int32_t remaining = (int32_t)rto - (int32_t)(millis() - sendTime);
+        if (remaining <= 0) {
+            if (retransmissions >= TCP_MAX_RETRANSMISSIONS || !retransmit()) {
+                // The server has gone away, or the segment can't be re-sent
+                abort();
+                return false;
+            }
+
+            // Back off, in case the network is congested
+            retransmissions++;
+            rto = (rto < TCP_MAX_RTO / 2) ? rto * 2 : TCP_MAX_RTO;
+            sendTime = millis();
+            continue;
+        }
+
+        _ether.waitForPacket(remaining);
+        if (_ether.receivePacket() && validSegment()) {
+            // Data is only kept if it arrives with the last acknowledgement,
+            // so that it is still in the buffer for receive() or havePacket()
+            if (processSegment(acceptReply)) {
+                _replyWaiting = true;
+            }
+        }
+    }
+
+    return true;
+}
+
+boolean TCPClient::waitForWindow()
+{
+    uint32_t timeout = millis() + TCP_SEND_TIMEOUT;
+
+    while (_sendWindow == 0) {
+        if (!connected()) {
+            // The server reset the connection
+            return false;
+        }
+
+        int32_t remaining = timeout - millis();
+        if (remaining <= 0) {
+            // Give up, and tell the server
+            abort();
+            return false;
+        }
+
+        _ether.waitForPacket(remaining);
+        if (_ether.receivePacket() && validSegment()) {
+            // Wait for a window update
+            processSegment(false);
+        }
+    }
+
+    return true;
+}
+
+boolean TCPClient::retransmit()
+{
+    _ether.selectTransmitBuffer();
+
+    if (_state == TCP_STATE_SYN_SENT) {
+        sendSegment(TCP_FLAG_SYN, _sendUnacknowledged, 0);
+        return true;
+    }
+
+    // Work out how much data is waiting to be acknowledged, apart from the FIN
+    boolean finSent = (_state == TCP_STATE_FIN_WAIT_1 ||
+                       _state == TCP_STATE_CLOSING ||
+                       _state == TCP_STATE_LAST_ACK);
+    uint16_t length = _sendNext - _sendUnacknowledged - (finSent ? 1 : 0);
+
+    if (length > 0) {
+        // Ask the application to write the unacknowledged part of the message again
+        int16_t savedWritePos = _writePos;
+        uint16_t savedSegmentLimit = _segmentLimit;
+
+        _writePos = -1;
+        _segmentLimit = length;
+        _rewriteSkip = _sendUnacknowledged - _messageStart;
+        _rewritePos = 0;
+        _rewriting = true;
+
+        boolean written = rewriteMessage();
+
+        _rewriting = false;
+        _writePos = savedWritePos;
+        _segmentLimit = savedSegmentLimit;
+
+        if (!written || _rewritePos != length) {
+            // The application didn't write as much as it did before
+            return false;
+        }
+    }
+
+    uint8_t flags = TCP_FLAG_ACK;
+    if (length > 0) {
+        flags |= TCP_FLAG_PSH;
+    }
+    if (finSent) {
+        flags |= TCP_FLAG_FIN;
+    }
+
+    sendSegment(flags, _sendUnacknowledged, length);
+    return true;
+}
+
+void TCPClient::abort()
+{
+    if (_state != TCP_STATE_SYN_SENT && _state != TCP_STATE_CLOSED) {
+        _ether.selectTransmitBuffer();
+        sendSegment(TCP_FLAG_RST | TCP_FLAG_ACK, _sendNext, 0);
+    }
+    _state = TCP_STATE_CLOSED;
+}
+
+uint16_t TCPClient::segmentLimit()
+{
+    // The server might not have sent a Maximum Segment Size option,
+    // but it must accept segments of the default size
+    uint16_t limit = (TCP_WINDOW_SIZE < TCP_DEFAULT_MSS) ? TCP_WINDOW_SIZE : TCP_DEFAULT_MSS;
+
+    // waitForWindow() has already checked that the window is open
+    if (_sendWindow < limit) {
+        limit = _sendWindow;
+    }
+
+    return limit;
+}
+
+void TCPClient::sendAck()
+{
+    _ackPending = false;
+    sendSegment(TCP_FLAG_ACK, _sendNext, 0);
+}
+
+void TCPClient::sendSegment(uint8_t flags, uint32_t seq, uint16_t length)
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_header *tcpHeader = TCP_HEADER_PTR;
+
+    // Pick up the latest MAC address from the Neighbour Cache
+    MACAddress *mac = _ether.lookupNeighbour(_remoteAddress);
+    if (mac) {
+        _remoteMac = *mac;
+    }
+
+    packet.setDestination(_remoteAddress);
+    packet.setEtherDestination(_remoteMac);
+    _ether.prepareSend();
+    packet.setProtocol(IP6_PROTO_TCP);
+
+    tcpHeader->sourcePort = htons(_localPort);
+    tcpHeader->destinationPort = htons(_remotePort);
+    tcpHeader->sequenceNum = htonl(seq);
+    if (flags & TCP_FLAG_ACK) {
+        tcpHeader->acknowledgementNum = htonl(_receiveNext);
+        _ackPending = false;
+    } else {
+        tcpHeader->acknowledgementNum = 0;
+    }
+
+    tcpHeader->dataOffset = (TCP_TRANSMIT_HEADER_LEN / 4) << 4;
+    tcpHeader->flags = flags;
+    tcpHeader->window = htons(TCP_WINDOW_SIZE);
+    tcpHeader->urgentPointer = 0;
+
+    tcpHeader->mssOptionKind = 2;
+    tcpHeader->mssOptionLen = 4;
+    tcpHeader->mssOptionValue = tcpHeader->window;
+
+    packet.setPayloadLength(TCP_TRANSMIT_HEADER_LEN + length);
+
+    tcpHeader->checksum = 0;
+    tcpHeader->checksum = htons(packet.calculateChecksum());
+
+    _ether.send();
+}
+
+uint16_t TCPClient::packetSourcePort()
+{
+    IPv6Packet& packet = _ether.packet();
+    return ntohs(TCP_HEADER_PTR->sourcePort);
+}
+
+uint16_t TCPClient::packetDestinationPort()
+{
+    IPv6Packet& packet = _ether.packet();
+    return ntohs(TCP_HEADER_PTR->destinationPort);
+}
+
+uint8_t* TCPClient::payload()
+{
+    IPv6Packet& packet = _ether.packet();
+    return packet.payload() + TCP_RECEIVE_HEADER_LEN;
+}
+
+uint16_t TCPClient::payloadLength()
+{
+    IPv6Packet& packet = _ether.packet();
+    return packet.payloadLength() - TCP_RECEIVE_HEADER_LEN;
+}
+
+uint8_t* TCPClient::transmitPayload()
+{
+    IPv6Packet& packet = _ether.packet();
+    return packet.payload() + TCP_TRANSMIT_HEADER_LEN;
+}
@@ -0,0 +1,291 @@
+/**
+ * Header file for the TCPClient class
+ * @file TCPClient.h
+ */
+
+#ifndef TCPClient_H
+#define TCPClient_H
+
+#include <stdint.h>
+#include "IPv6Packet.h"
+#include "Socket.h"
+#include "tcp.h"
+
+/**
+ * Class for making TCP connections to a server
+ *
+ * Set the address and port of the server using setRemoteAddress(), and
+ * then call connect(). Data is written using print() or write(), and sent
+ * by calling send(). Each segment waits for the server to acknowledge it
+ * before continuing, so a message can be longer than the packet buffer.
+ *
+ * Data from the server is read one segment at a time, either by calling
+ * receive(), which waits for the next segment, or by calling havePacket()
+ * after receivePacket() in the main loop. The first segment of a reply may
+ * arrive while send() is waiting for the message to be acknowledged, so
+ * call receive() or havePacket() before the next receivePacket().
+ *
+ * Sent segments are not kept. To be able to re-send a lost segment,
+ * sub-class TCPClient and implement rewriteMessage(), which writes the
+ * same message again; only the bytes that need re-sending are kept.
+ * Otherwise, the connection is reset if a segment is lost.
+ *
+ * This class inherits from Print, so you you can also use the print()
+ * and println() functions when composing a message.
+ */
+class TCPClient : public Socket {
+
+public:
+
+    /**
+     * Construct a TCP client, with a random local port number for each connection
+     *
+     * @param ether The Ethernet interface to attach the client to
+     */
+    TCPClient(EtherSia &ether);
+
+    /**
+     * Construct a TCP client, with a fixed local port number
+     *
+     * @param ether The Ethernet interface to attach the client to
+     * @param localPort The local TCP port number to connect from
+     */
+    TCPClient(EtherSia &ether, uint16_t localPort);
+
+    /**
+     * Open a connection to the server set by setRemoteAddress()
+     *
+     * Any existing connection is closed first.
+     *
+     * @return true if the connection was opened, false if the server
+     *         refused it or didn't reply
+     */
+    boolean connect();
+
+    /**
+     * Check if the connection is open, so that data can be sent
+     *
+     * @return true if the connection is open
+     */
+    boolean connected();
+
+    /**
+     * Close the connection gracefully
+     *
+     * Waits for the server to acknowledge the end of the connection,
+     * and for the server to close its end too.
+     */
+    void close();
+
+    /**
+     * Check if the packet in the buffer contains data from the server
+     *
+     * This method also has a side effect of handling the other
+     * TCP packets from the server, and acknowledging data that has
+     * been handled, once the buffer is free.
+     *
+     * @return true if there is data in the buffer for this connection
+     */
+    boolean havePacket();
+
+    /**
+     * Wait for the next segment of data from the server
+     *
+     * Any data that has already been received is acknowledged first,
+     * and then overwritten.
+     *
+     * @return true if data was received, false if the server closed
+     *         the connection or nothing arrived before TCP_RECEIVE_TIMEOUT
+     */
+    boolean receive();
+
+    /**
+     * Get the IPv6 source port number of the last TCP packet received
+     *
+     * @note Please call havePacket() first, before calling this method.
+     * @return The source port number
+     */
+    uint16_t packetSourcePort();
+
+    /**
+     * Get the IPv6 destination port number of the last TCP packet received
+     *
+     * @note Please call havePacket() first, before calling this method.
+     * @return The destination port number
+     */
+    uint16_t packetDestinationPort();
+
+    /**
+     * Get a pointer to the TCP payload of the last received packet
+     *
+     * @note Please call havePacket() first, before calling this method.
+     * @return A pointer to the payload
+     */
+    virtual uint8_t* payload();
+
+    /**
+     * Get the length (in bytes) of the last received TCP packet payload
+     *
+     * @note Please call havePacket() first, before calling this method.
+     * @return The length of the payload
+     */
+    virtual uint16_t payloadLength();
+
+    /**
+     * Get a pointer to the next TCP packet payload to be sent
+     *
+     * @return A pointer to the transmit payload buffer
+     */
+    virtual uint8_t* transmitPayload();
+
+    /**
+     * Write a single character into the packet buffer
+     *
+     * If the current segment is full, it is sent first, and a new one started.
+     *
+     * @param chr The character to write
+     * @return The number of bytes written to the buffer
+     */
+    virtual size_t write(uint8_t chr);
+
+    /**
+     * Write a message again, so that part of it can be re-sent
+     *
+     * This is called when a segment hasn't been acknowledged in time.
+     * It should write exactly the same bytes as the message that was
+     * being sent, using print(), write() or send() with a pointer to the
+     * data. Only the bytes that need re-sending are kept in the packet buffer.
+     *
+     * The default implementation returns false.
+     *
+     * @return true if the message was written
+     */
+    virtual boolean rewriteMessage();
+
+protected:
+
+    /**
+     * Internal function to send a TCP packet, using data contained in buffer
+     *
+     * @param length The length of the data in the buffer
+     */
+    virtual void sendInternal(uint16_t length, boolean isReply);
+
+    /**
+     * Check that the packet in the buffer is a valid TCP packet for this connection
+     *
+     * @return true if the packet should be processed
+     */
+    boolean validSegment();
+
+    /**
+     * Update the state of the connection, using the TCP packet in the buffer
+     *
+     * @param acceptData false to only process the acknowledgement, without accepting any data
+     *        (data is also refused until everything sent has been acknowledged)
+     * @return true if the packet contains data for the application
+     */
+    boolean processSegment(boolean acceptData);
+
+    /**
+     * Send the data in the buffer, and wait for the server to acknowledge it
+     *
+     * @param flags The TCP flags to set
+     * @param length The length of the data after the TCP header
+     * @param acceptReply true to keep data that arrives with the acknowledgement
+     * @return false if the connection was closed, or the server stopped acknowledging
+     */
+    boolean sendData(uint8_t flags, uint16_t length, boolean acceptReply);
+
+    /**
+     * Process packets until everything that has been sent is acknowledged,
+     * re-sending the oldest unacknowledged segment if it takes too long
+     *
+     * @param acceptReply true to keep data that arrives with the acknowledgement
+     * @return false if the connection was closed, or timed out
+     */
+    boolean waitForAck(boolean acceptReply);
+
+    /**
+     * Process packets until the server's receive window has room for another segment
+     *
+     * @return false if the connection was closed, or timed out
+     */
+    boolean waitForWindow();
+
+    /**
+     * Re-send the oldest unacknowledged segment
+     *
+     * @return false if the segment couldn't be re-created
+     */
+    boolean retransmit();
+
+    /**
+     * Reset the connection, and tell the server
+     */
+    void abort();
+
+    /**
+     * Get the largest segment that can be sent to the server now
+     *
+     * @return the number of bytes
+     */
+    uint16_t segmentLimit();
+
+    /**
+     * Acknowledge all the data received from the server, if it hasn't been already
+     */
+    void sendAck();
+
+    /**
+     * Write the TCP header and send the packet in the buffer to the server
+     *
+     * @param flags The TCP flags to set
+     * @param seq The sequence number
+     * @param length The length of the data after the TCP header
+     */
+    void sendSegment(uint8_t flags, uint32_t seq, uint16_t length);
+
+    /** The state of the connection (one of the tcpState values) */
+    uint8_t _state;
+
+    /** true if a new local port number is picked for each connection */
+    boolean _randomLocalPort;
+
+    /** SND.WND - the window advertised by the server */
+    uint16_t _sendWindow;
+
+    /** SND.UNA - the oldest sequence number not yet acknowledged */
+    uint32_t _sendUnacknowledged;
+
+    /** SND.NXT - the next sequence number to be sent */
+    uint32_t _sendNext;
+
+    /** RCV.NXT - the next sequence number expected from the server */
+    uint32_t _receiveNext;
+
+    /** true if data has been received that hasn't been acknowledged yet */
+    boolean _ackPending;
+
+    /** true if data arrived while sending, and hasn't been returned by receive() yet */
+    boolean _replyWaiting;
+
+    /** The sequence number of the first byte of the message being sent */
+    uint32_t _messageStart;
+
+    /** The maximum number of bytes that can be written into the current segment */
+    uint16_t _segmentLimit;
+
+    /** true while rewriteMessage() is being called */
+    boolean _rewriting;
+
+    /** The number of bytes still to be skipped by rewriteMessage() */
+    uint32_t _rewriteSkip;
+
+    /** The number of bytes kept from rewriteMessage() */
+    uint16_t _rewritePos;
+
+};
+
+
+#endif
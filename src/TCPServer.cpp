@@ -3,6 +3,14 @@
 
 TCPServer::TCPServer(EtherSia &ether, uint16_t localPort) : Socket(ether, localPort)
 {
+    for (uint8_t i = 0; i < TCP_CONNECTION_COUNT; i++) {
+        _connections[i].state = TCP_STATE_CLOSED;
+    }
+    _connection = NULL;
+    _segmentLimit = 0;
+    _rewriting = false;
+    _rewriteSkip = 0;
+    _rewritePos = 0;
 }
 
 boolean TCPServer::havePacket()
@@ -10,6 +18,31 @@ boolean TCPServer::havePacket()
     IPv6Packet& packet = _ether.packet();
     struct tcp_header *tcpHeader = TCP_HEADER_PTR;
 
+    if (!_ether.bufferContainsReceived()) {
+        // The buffer is free, so use it to re-send anything
+        // that hasn't been acknowledged in time
+        processTimers();
+        return false;
+    }
+
+    if (!validSegment()) {
+        return false;
+    }
+
+    // The flags of an accepted packet are cleared, so that
+    // calling havePacket() again doesn't process it twice
+    if (tcpHeader->flags == 0) {
+        return _connection != NULL && _connection == findConnection();
+    }
+
+    _connection = NULL;
+    return processSegment(true);
+}
+
+boolean TCPServer::validSegment()
+{
+    IPv6Packet& packet = _ether.packet();
+
     if (!_ether.bufferContainsReceived()) {
         return false;
     }
@@ -24,61 +57,583 @@ boolean TCPServer::havePacket()
         return false;
     }
 
-    if (tcpHeader->flags & TCP_FLAG_RST) {
+    if (!_ether.verifyChecksum()) {
+        // Packet is corrupt
         return false;
     }
 
-    if (tcpHeader->flags & TCP_FLAG_FIN) {
-        tcpHeader->flags = TCP_FLAG_FIN | TCP_FLAG_ACK;
-        sendReply((uint16_t)0);
+    return true;
+}
+
+/**
+ * Get the value of the Maximum Segment Size option in a TCP header
+ * @private
+ */
+static uint16_t tcpMssOption(IPv6Packet& packet)
+{
+    uint8_t *options = packet.payload() + TCP_MINIMUM_HEADER_LEN;
+    uint8_t optionsLen = TCP_RECEIVE_HEADER_LEN - TCP_MINIMUM_HEADER_LEN;
+
+    for (uint8_t i = 0; i < optionsLen;) {
+        if (options[i] == 0) {
+            // End of options list
+            break;
+        } else if (options[i] == 1) {
+            // No operation
+            i++;
+        } else if (i + 1 >= optionsLen || options[i + 1] < 2) {
+            // Malformed option
+            break;
+        } else {
+            if (options[i] == 2 && options[i + 1] == 4 && i + 3 < optionsLen) {
+                return bytesToWord(options[i + 2], options[i + 3]);
+            }
+            i += options[i + 1];
+        }
+    }
+
+    return TCP_DEFAULT_MSS;
+}
+
+boolean TCPServer::processSegment(boolean acceptData)
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_header *tcpHeader = TCP_HEADER_PTR;
+    uint32_t seq = ntohl(tcpHeader->sequenceNum);
+    uint32_t ack = ntohl(tcpHeader->acknowledgementNum);
+    uint16_t length = payloadLength();
+    uint8_t flags = tcpHeader->flags;
+    struct tcp_connection *conn = findConnection();
+
+    if (flags & TCP_FLAG_RST) {
+        // Only accept a reset that is exactly in sequence (RFC5961)
+        if (conn && seq == conn->receiveNext) {
+            conn->state = TCP_STATE_CLOSED;
+        }
         return false;
     }
 
-    if (tcpHeader->flags & TCP_FLAG_SYN) {
+    if (flags & TCP_FLAG_SYN) {
+        if (flags & TCP_FLAG_ACK) {
+            // We never send a SYN, so shouldn't get a SYN-ACK
+            return false;
+        }
+
+        if (conn && conn->state == TCP_STATE_SYN_RECEIVED && seq + 1 == conn->receiveNext) {
+            // Our SYN-ACK must have been lost - send it again
+            sendControl(TCP_FLAG_SYN | TCP_FLAG_ACK, conn->sendUnacknowledged, conn->receiveNext);
+            return false;
+        }
+
+        if (conn == _connection && conn != NULL) {
+            // Don't re-use a connection that a response is being sent on
+            return false;
+        } else if (conn) {
+            // The client has started again
+            conn->state = TCP_STATE_CLOSED;
+        }
+
+        conn = newConnection();
+        if (conn == NULL) {
+            // No room - ignore the SYN, the client will try again
+            return false;
+        }
+
         // Initialise our sequence number to a random number
-        // (this is used later in sendInternal)
-        tcpHeader->acknowledgementNum = random();
+        conn->state = TCP_STATE_SYN_RECEIVED;
+        conn->sendUnacknowledged = random();
+        conn->sendNext = conn->sendUnacknowledged + 1;
+        conn->sendMax = conn->sendNext;
+        conn->receiveNext = seq + 1;
+        conn->mss = tcpMssOption(packet);
+
+        // Accept the connection, and measure how long the handshake takes
+        sendControl(TCP_FLAG_SYN | TCP_FLAG_ACK, conn->sendUnacknowledged, conn->receiveNext);
+        conn->rttTiming = true;
+        conn->rttSequence = conn->sendNext;
+        conn->rttStart = conn->sendTime = millis();
+        return false;
+    }
+
+    if (conn == NULL) {
+        // Not a connection we know about (perhaps one we have finished with),
+        // so data in it mustn't be handled as a new request
+        _ether.tcpSendRSTReply();
+        return false;
+    }
+
+    conn->lastActivity = millis();
+
+    if (!(flags & TCP_FLAG_ACK)) {
+        // Every segment after the SYN should have the ACK flag set
+        return false;
+    }
+
+    if (conn->state == TCP_STATE_SYN_RECEIVED && ack != conn->sendNext) {
+        // Doesn't acknowledge our SYN-ACK, so the handshake hasn't completed
+        _ether.tcpSendRSTReply();
+        return false;
+    }
+
+    if (TCP_SEQ_LE(conn->sendUnacknowledged, ack) && TCP_SEQ_LE(ack, conn->sendNext)) {
+        if (conn->sendUnacknowledged != ack) {
+            // Something new has been acknowledged - restart the retransmission timer
+            conn->sendUnacknowledged = ack;
+            conn->sendTime = millis();
+            conn->retransmissions = 0;
+
+            if (conn->rttTiming && TCP_SEQ_LE(conn->rttSequence, ack)) {
+                updateRoundTripTime(conn, millis() - conn->rttStart);
+                conn->rttTiming = false;
+            }
+        }
+        conn->sendWindow = ntohs(tcpHeader->window);
+    }
+
+    if (conn->sendUnacknowledged == conn->sendNext) {
+        // Everything we have sent has been acknowledged
+        if (conn->state == TCP_STATE_SYN_RECEIVED) {
+            conn->state = TCP_STATE_ESTABLISHED;
+        } else if (conn->state == TCP_STATE_FIN_WAIT_1) {
+            conn->state = TCP_STATE_FIN_WAIT_2;
+        } else if (conn->state == TCP_STATE_CLOSING) {
+            conn->state = TCP_STATE_TIME_WAIT;
+        } else if (conn->state == TCP_STATE_LAST_ACK) {
+            conn->state = TCP_STATE_CLOSED;
+            return false;
+        }
+    }
+
+    if (!acceptData || (length == 0 && !(flags & TCP_FLAG_FIN))) {
+        // Nothing more to do for a segment that only acknowledges
+        return false;
+    }
 
-        // Accept the connection
-        tcpHeader->flags = TCP_FLAG_SYN | TCP_FLAG_ACK;
-        sendReply((uint16_t)0);
+    if (seq != conn->receiveNext) {
+        uint32_t end = seq + length + ((flags & TCP_FLAG_FIN) ? 1 : 0);
+        if (length > 0 && end == conn->receiveNext && conn->sendUnacknowledged != conn->sendNext &&
+                conn->sendUnacknowledged == conn->responseStart) {
+            // The client has re-sent the request because our reply was lost:
+            // rewind, so that the application sends the same reply again
+            if (conn->state == TCP_STATE_FIN_WAIT_1) {
+                conn->state = TCP_STATE_ESTABLISHED;
+            } else if (conn->state == TCP_STATE_LAST_ACK) {
+                conn->state = TCP_STATE_CLOSE_WAIT;
+            }
 
-        // We have handled the SYN
+            if (conn->state == TCP_STATE_ESTABLISHED || conn->state == TCP_STATE_CLOSE_WAIT) {
+                // The reply is being re-sent, so it can't be timed (Karn's algorithm)
+                conn->sendNext = conn->responseStart;
+                conn->sendTime = millis();
+                conn->rttTiming = false;
+                _connection = conn;
+                _writePos = -1;
+                tcpHeader->flags = 0;
+                return true;
+            }
+        }
+
+        // Duplicate or out of order - tell the client what we are expecting next
+        sendControl(TCP_FLAG_ACK, conn->sendNext, conn->receiveNext);
         return false;
     }
 
-    // Packet contains data that needs to be handled
-    if (payloadLength() > 0) {
+    conn->receiveNext += length;
+    boolean deliver = (length > 0 && conn->state == TCP_STATE_ESTABLISHED);
+
+    if (flags & TCP_FLAG_FIN) {
+        conn->receiveNext++;
+        if (conn->state == TCP_STATE_ESTABLISHED) {
+            conn->state = TCP_STATE_CLOSE_WAIT;
+        } else if (conn->state == TCP_STATE_FIN_WAIT_1) {
+            conn->state = TCP_STATE_CLOSING;
+        } else if (conn->state == TCP_STATE_FIN_WAIT_2) {
+            conn->state = TCP_STATE_TIME_WAIT;
+        }
+    }
+
+    if (deliver) {
+        // Packet contains data that needs to be handled
+        // (the reply acknowledges it)
+        conn->responseStart = conn->sendNext;
+        conn->responseId = 0;
+        _connection = conn;
         _writePos = -1;
         tcpHeader->flags = 0;
         return true;
     }
 
-    // Something else?
+    if (conn->state == TCP_STATE_CLOSE_WAIT) {
+        // The client has closed the connection without sending a request
+        sendControl(TCP_FLAG_FIN | TCP_FLAG_ACK, conn->sendNext, conn->receiveNext);
+        conn->sendNext++;
+        conn->sendMax = conn->sendNext;
+        conn->state = TCP_STATE_LAST_ACK;
+    } else {
+        sendControl(TCP_FLAG_ACK, conn->sendNext, conn->receiveNext);
+    }
+
+    return false;
+}
+
+boolean TCPServer::receiveMore()
+{
+    struct tcp_connection *conn = _connection;
+    uint32_t timeout = millis() + TCP_RECEIVE_TIMEOUT;
+
+    if (conn == NULL || _writePos != -1) {
+        // Not handling a request, or already replying to it
+        return false;
+    }
+
+    // Acknowledge straight away, so that the client sends the next segment
+    sendControl(TCP_FLAG_ACK, conn->sendNext, conn->receiveNext);
+
+    while (conn->state == TCP_STATE_ESTABLISHED) {
+        int32_t remaining = timeout - millis();
+        if (remaining <= 0) {
+            break;
+        }
+
+        // Re-send anything on other connections that hasn't been acknowledged in time
+        processTimers();
+
+        _ether.waitForPacket(remaining < TCP_MIN_RTO ? remaining : TCP_MIN_RTO);
+        if (!_ether.receivePacket() || !validSegment()) {
+            continue;
+        }
+
+        if (findConnection() != conn) {
+            // Only look at acknowledgements on other connections
+            processSegment(false);
+        } else if (processSegment(true)) {
+            return true;
+        }
+    }
+
+    if (conn->state != TCP_STATE_ESTABLISHED && conn->state != TCP_STATE_CLOSE_WAIT) {
+        // The connection has gone - there is nothing to reply to
+        _connection = NULL;
+    }
+
     return false;
 }
 
+size_t TCPServer::write(uint8_t chr)
+{
+    if (_rewriting) {
+        // Only keep the bytes that are being re-sent
+        if (_rewriteSkip > 0) {
+            _rewriteSkip--;
+        } else if (_rewritePos < _segmentLimit) {
+            transmitPayload()[_rewritePos++] = chr;
+        }
+        return 1;
+    }
+
+    if (_connection == NULL) {
+        // Not replying to anything
+        return 0;
+    }
+
+    if (_writePos == -1) {
+        // Starting a new response - the request is still in the buffer,
+        // so the first segment is sent without waiting
+        _segmentLimit = segmentLimit();
+        if (_segmentLimit == 0) {
+            _segmentLimit = 1;
+        }
+    } else if (_writePos >= _segmentLimit) {
+        if (!sendPartial()) {
+            return 0;
+        }
+    }
+
+    return Socket::write(chr);
+}
+
+boolean TCPServer::sendPartial()
+{
+    sendData(TCP_FLAG_ACK | TCP_FLAG_PSH, _writePos);
+
+    if (!waitForWindow()) {
+        _connection = NULL;
+        _writePos = -1;
+        return false;
+    }
+
+    // The buffer may now contain a received packet
+    _ether.selectTransmitBuffer();
+    _writePos = 0;
+    _segmentLimit = segmentLimit();
+    return true;
+}
+
+boolean TCPServer::waitForWindow()
+{
+    struct tcp_connection *conn = _connection;
+    uint32_t timeout = millis() + TCP_SEND_TIMEOUT;
+
+    while (true) {
+        // Wait for room for a whole segment, or for everything
+        // to be acknowledged if the window is smaller than that
+        uint16_t wanted = segmentSize(conn);
+        if (conn->sendWindow < wanted) {
+            wanted = conn->sendWindow;
+        }
+
+        uint32_t inFlight = conn->sendNext - conn->sendUnacknowledged;
+        if (wanted > 0 && inFlight + wanted <= conn->sendWindow) {
+            return true;
+        }
+
+        if (conn->state == TCP_STATE_CLOSED) {
+            // The client reset the connection
+            return false;
+        }
+
+        int32_t remaining = timeout - millis();
+        if (remaining <= 0) {
+            // Give up, and tell the client
+            _ether.selectTransmitBuffer();
+            sendData(TCP_FLAG_RST | TCP_FLAG_ACK, 0);
+            conn->state = TCP_STATE_CLOSED;
+            return false;
+        }
+
+        // Re-send anything that hasn't been acknowledged in time
+        processTimers();
+
+        _ether.waitForPacket(remaining < conn->rto ? remaining : conn->rto);
+        if (_ether.receivePacket() && validSegment()) {
+            // Only look at acknowledgements, while sending
+            processSegment(false);
+        }
+    }
+}
+
+uint16_t TCPServer::segmentSize(struct tcp_connection *conn)
+{
+    return conn->mss < TCP_WINDOW_SIZE ? conn->mss : TCP_WINDOW_SIZE;
+}
+
+uint16_t TCPServer::segmentLimit()
+{
+    struct tcp_connection *conn = _connection;
+    uint32_t window = conn->sendUnacknowledged + conn->sendWindow - conn->sendNext;
+    uint16_t limit = segmentSize(conn);
+
+    if ((int32_t)window < 0) {
+        return 0;
+    } else if (window < limit) {
+        return window;
+    } else {
+        return limit;
+    }
+}
+
 void TCPServer::sendInternal(uint16_t length, boolean /*isReply*/)
+{
+    if (_connection == NULL || _rewriting) {
+        return;
+    }
+
+    sendData(TCP_FLAG_ACK | TCP_FLAG_FIN | TCP_FLAG_PSH, length);
+
+    if (_connection->state == TCP_STATE_ESTABLISHED) {
+        _connection->state = TCP_STATE_FIN_WAIT_1;
+    } else if (_connection->state == TCP_STATE_CLOSE_WAIT) {
+        _connection->state = TCP_STATE_LAST_ACK;
+    }
+
+    _connection = NULL;
+}
+
+void TCPServer::sendData(uint8_t flags, uint16_t length)
+{
+    struct tcp_connection *conn = _connection;
+    uint32_t end = conn->sendNext + length + ((flags & TCP_FLAG_FIN) ? 1 : 0);
+
+    if (conn->sendUnacknowledged == conn->sendNext) {
+        // Nothing else is waiting to be acknowledged - start the retransmission timer
+        conn->sendTime = millis();
+    }
+
+    if (!conn->rttTiming && end != conn->sendNext && !TCP_SEQ_LT(conn->sendNext, conn->sendMax)) {
+        // Measure the round-trip time using this segment, unless it has been sent before
+        conn->rttTiming = true;
+        conn->rttSequence = end;
+        conn->rttStart = millis();
+    }
+
+    sendConnection(conn, flags, conn->sendNext, length);
+    conn->sendNext = end;
+    if (TCP_SEQ_LT(conn->sendMax, end)) {
+        conn->sendMax = end;
+    }
+}
+
+void TCPServer::sendConnection(struct tcp_connection *conn, uint8_t flags, uint32_t seq, uint16_t length)
 {
     IPv6Packet& packet = _ether.packet();
     struct tcp_header *tcpHeader = TCP_HEADER_PTR;
 
-    uint32_t seq = tcpHeader->acknowledgementNum;
-    uint32_t ack = ntohl(tcpHeader->sequenceNum);
-    uint16_t receivedLen = payloadLength();
-    if (receivedLen == 0)
-        receivedLen = 1;
+    // The buffer might not contain the request, so address it from the connection
+    packet.setDestination(conn->remoteAddress);
+    packet.setEtherDestination(conn->remoteMac);
+    _ether.prepareSend();
+    packet.setProtocol(IP6_PROTO_TCP);
 
-    if (tcpHeader->flags == 0) {
-        tcpHeader->flags = TCP_FLAG_ACK | TCP_FLAG_FIN | TCP_FLAG_PSH;
+    tcpHeader->sourcePort = htons(_localPort);
+    tcpHeader->destinationPort = htons(conn->remotePort);
+    sendSegment(flags, seq, conn->receiveNext, length);
+}
+
+void TCPServer::processTimers()
+{
+    for (uint8_t i = 0; i < TCP_CONNECTION_COUNT; i++) {
+        struct tcp_connection *conn = &_connections[i];
+        if (conn->state == TCP_STATE_CLOSED || conn->sendUnacknowledged == conn->sendNext) {
+            continue;
+        }
+
+        if ((unsigned long)(millis() - conn->sendTime) >= conn->rto) {
+            retransmit(conn);
+        }
+    }
+}
+
+void TCPServer::retransmit(struct tcp_connection *conn)
+{
+    _ether.selectTransmitBuffer();
+
+    if (conn->retransmissions >= TCP_MAX_RETRANSMISSIONS) {
+        // The client has gone away
+        sendConnection(conn, TCP_FLAG_RST | TCP_FLAG_ACK, conn->sendNext, 0);
+        conn->state = TCP_STATE_CLOSED;
+        return;
+    }
+
+    // Back off, and don't time the re-sent segment (Karn's algorithm)
+    conn->retransmissions++;
+    conn->rto = (conn->rto < TCP_MAX_RTO / 2) ? conn->rto * 2 : TCP_MAX_RTO;
+    conn->rttTiming = false;
+    conn->sendTime = millis();
+
+    if (conn->state == TCP_STATE_SYN_RECEIVED) {
+        sendConnection(conn, TCP_FLAG_SYN | TCP_FLAG_ACK, conn->sendUnacknowledged, 0);
+        return;
     }
 
+    // Work out how much data is waiting to be acknowledged, apart from the FIN
+    boolean finSent = (conn->state == TCP_STATE_FIN_WAIT_1 ||
+                       conn->state == TCP_STATE_CLOSING ||
+                       conn->state == TCP_STATE_LAST_ACK);
+    uint32_t outstanding = conn->sendNext - conn->sendUnacknowledged - (finSent ? 1 : 0);
+    uint16_t length = 0;
+
+    if (outstanding > 0) {
+        length = rewrite(conn, outstanding < segmentSize(conn) ? outstanding : segmentSize(conn));
+        if (length == 0) {
+            // Can't re-create the data - hope that the client re-sends its request
+            return;
+        }
+    }
+
+    uint8_t flags = TCP_FLAG_ACK;
+    if (length > 0) {
+        flags |= TCP_FLAG_PSH;
+    }
+    if (finSent && length == outstanding) {
+        flags |= TCP_FLAG_FIN;
+    }
+
+    sendConnection(conn, flags, conn->sendUnacknowledged, length);
+}
+
+uint16_t TCPServer::rewrite(struct tcp_connection *conn, uint16_t length)
+{
+    // Save the state of the response currently being written (if any)
+    struct tcp_connection *savedConnection = _connection;
+    int16_t savedWritePos = _writePos;
+    uint16_t savedSegmentLimit = _segmentLimit;
+
+    _connection = conn;
+    _writePos = -1;
+    _segmentLimit = length;
+    _rewriteSkip = conn->sendUnacknowledged - conn->responseStart;
+    _rewritePos = 0;
+    _rewriting = true;
+
+    boolean written = rewriteResponse(conn->responseId);
+
+    _rewriting = false;
+    _connection = savedConnection;
+    _writePos = savedWritePos;
+    _segmentLimit = savedSegmentLimit;
+
+    if (!written || _rewritePos != length) {
+        // The application didn't write as much as it did before
+        return 0;
+    }
+
+    return length;
+}
+
+void TCPServer::updateRoundTripTime(struct tcp_connection *conn, uint16_t rtt)
+{
+    if (conn->srtt == 0 && conn->rttvar == 0) {
+        // First measurement
+        conn->srtt = rtt;
+        conn->rttvar = rtt / 2;
+    } else {
+        uint16_t delta = (conn->srtt > rtt) ? conn->srtt - rtt : rtt - conn->srtt;
+        conn->rttvar = ((3 * (uint32_t)conn->rttvar) + delta) / 4;
+        conn->srtt = ((7 * (uint32_t)conn->srtt) + rtt) / 8;
+    }
+
+    uint32_t rto = conn->srtt + (4 * (uint32_t)conn->rttvar);
+    if (rto < TCP_MIN_RTO) {
+        rto = TCP_MIN_RTO;
+    } else if (rto > TCP_MAX_RTO) {
+        rto = TCP_MAX_RTO;
+    }
+    conn->rto = rto;
+}
+
+void TCPServer::setResponseId(uint8_t responseId)
+{
+    if (_connection) {
+        _connection->responseId = responseId;
+    }
+}
+
+boolean TCPServer::rewriteResponse(uint8_t /*responseId*/)
+{
+    return false;
+}
+
+void TCPServer::sendControl(uint8_t flags, uint32_t seq, uint32_t ack)
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_header *tcpHeader = TCP_HEADER_PTR;
+
+    _ether.prepareReply();
     tcpHeader->destinationPort = tcpHeader->sourcePort;
     tcpHeader->sourcePort = htons(_localPort);
-    tcpHeader->sequenceNum = seq;
-    tcpHeader->acknowledgementNum = htonl(ack + receivedLen);
+    sendSegment(flags, seq, ack, 0);
+}
+
+void TCPServer::sendSegment(uint8_t flags, uint32_t seq, uint32_t ack, uint16_t length)
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_header *tcpHeader = TCP_HEADER_PTR;
+
+    tcpHeader->sequenceNum = htonl(seq);
+    tcpHeader->acknowledgementNum = htonl(ack);
 
     tcpHeader->dataOffset = (TCP_TRANSMIT_HEADER_LEN / 4) << 4;
+    tcpHeader->flags = flags;
     tcpHeader->window = htons(TCP_WINDOW_SIZE);
     tcpHeader->urgentPointer = 0;
 
@@ -94,6 +649,74 @@ void TCPServer::sendInternal(uint16_t length, boolean /*isReply*/)
     _ether.send();
 }
 
+struct tcp_connection* TCPServer::findConnection()
+{
+    IPv6Packet& packet = _ether.packet();
+    uint16_t port = packetSourcePort();
+
+    for (uint8_t i = 0; i < TCP_CONNECTION_COUNT; i++) {
+        struct tcp_connection *conn = &_connections[i];
+        if (conn->state != TCP_STATE_CLOSED &&
+                conn->remotePort == port &&
+                conn->remoteAddress == packet.source()) {
+            return conn;
+        }
+    }
+
+    return NULL;
+}
+
+struct tcp_connection* TCPServer::newConnection()
+{
+    IPv6Packet& packet = _ether.packet();
+    struct tcp_connection *conn = NULL;
+
+    for (uint8_t i = 0; i < TCP_CONNECTION_COUNT; i++) {
+        struct tcp_connection *entry = &_connections[i];
+        if (entry->state == TCP_STATE_CLOSED) {
+            conn = entry;
+            break;
+        }
+
+        // Re-use the connection that has been idle for longest, if it is finished with
+        if (entry->state == TCP_STATE_TIME_WAIT ||
+                (unsigned long)(millis() - entry->lastActivity) > TCP_CONNECTION_TIMEOUT) {
+            if (conn == NULL || (long)(entry->lastActivity - conn->lastActivity) < 0) {
+                conn = entry;
+            }
+        }
+    }
+
+    if (conn) {
+        conn->remoteAddress = packet.source();
+        conn->remoteMac = packet.etherSource();
+        conn->remotePort = packetSourcePort();
+        conn->sendWindow = ntohs(TCP_HEADER_PTR->window);
+        conn->responseStart = 0;
+        conn->responseId = 0;
+        conn->retransmissions = 0;
+        conn->rto = TCP_INITIAL_RTO;
+        conn->srtt = 0;
+        conn->rttvar = 0;
+        conn->rttTiming = false;
+        conn->lastActivity = millis();
+    }
+
+    return conn;
+}
+
+uint8_t TCPServer::connectionCount()
+{
+    uint8_t count = 0;
+    for (uint8_t i = 0; i < TCP_CONNECTION_COUNT; i++) {
+        uint8_t state = _connections[i].state;
+        if (state != TCP_STATE_CLOSED && state != TCP_STATE_TIME_WAIT) {
+            count++;
+        }
+    }
+    return count;
+}
+
 uint16_t TCPServer::packetSourcePort()
 {
     IPv6Packet& packet = _ether.packet();
@@ -11,11 +11,50 @@
 #include "Socket.h"
 #include "tcp.h"
 
+#ifndef TCP_CONNECTION_COUNT
+/**
+ * The number of TCP connections that each TCPServer can keep track of at once
+ *
+ * When the table is full, new connections are ignored until an entry
+ * is freed (the client will re-send its SYN).
+ */
+#ifdef __AVR__
+#define TCP_CONNECTION_COUNT     (2)
+#else
+#define TCP_CONNECTION_COUNT     (4)
+#endif
+#endif
+
+/**
+ * How long (in milliseconds) a connection can be idle,
+ * before its entry may be re-used for a new connection
+ */
+#define TCP_CONNECTION_TIMEOUT   (30000)
+
 /**
  * Class for responding to TCP requests
  *
- * Requests and responses cannot be bigger than a single packet and
- * are limited by the size of the packet buffer.
+ * Each segment of a request is handled on its own, in the packet buffer.
+ * havePacket() returns true for the first segment, and receiveMore()
+ * acknowledges it and waits for the next one, so that requests that
+ * are bigger than the packet buffer can be read a segment at a time.
+ *
+ * Responses can be longer than the packet buffer: when the buffer is full,
+ * print() sends it as a segment and carries on in a new one. Before starting
+ * a new segment, it waits until the client's receive window has room for it.
+ * While waiting, requests on other connections are ignored, and their
+ * clients will send them again.
+ *
+ * Sent segments are not kept. To be able to re-send lost segments,
+ * sub-class TCPServer and implement rewriteResponse(), which writes the
+ * same response again; only the bytes that need re-sending are kept.
+ * Otherwise, a response can only be re-sent if the client re-sends
+ * its request.
+ *
+ * The state of each connection is kept in a small table, so that
+ * several clients can be connected at the same time, and segments
+ * that are duplicated or arrive out of order are not mistaken for
+ * new requests.
  *
  * This class inherits from Print, so you you can also use the print()
  * and println() functions when composing a reply.
@@ -43,6 +82,21 @@ public:
      */
     boolean havePacket();
 
+    /**
+     * Acknowledge the segment of the request that has been handled,
+     * and wait for the next segment on the same connection
+     *
+     * The payload of the current segment is overwritten. While waiting,
+     * requests on other connections are ignored, and their clients will
+     * send them again.
+     *
+     * @note Please call havePacket() first, and before writing the reply.
+     * @return true if another segment of data was received,
+     *         false if the client closed the connection or nothing arrived
+     *         before TCP_RECEIVE_TIMEOUT
+     */
+    boolean receiveMore();
+
     /**
      * Get the IPv6 source port number of the last TCP packet received
      *
@@ -82,6 +136,50 @@ public:
      */
     virtual uint8_t* transmitPayload();
 
+    /**
+     * Get the number of connections that are currently open
+     *
+     * Connections in the TIME-WAIT state are not counted.
+     *
+     * @return The number of connections
+     */
+    uint8_t connectionCount();
+
+    /**
+     * Write a single character into the packet buffer
+     *
+     * If the current segment is full, it is sent first, and a new one started.
+     *
+     * @param chr The character to write
+     * @return The number of bytes written to the buffer
+     */
+    virtual size_t write(uint8_t chr);
+
+    /**
+     * Set a number that identifies the response being written
+     *
+     * It is passed to rewriteResponse() if part of the response is lost.
+     *
+     * @note Please call havePacket() first, before calling this method.
+     * @param responseId A number chosen by the application
+     */
+    void setResponseId(uint8_t responseId);
+
+    /**
+     * Write a response again, so that part of it can be re-sent
+     *
+     * This is called when a segment hasn't been acknowledged in time.
+     * It should write exactly the same bytes as the original response,
+     * using print() or write(), without calling sendReply(). Only the
+     * bytes that need re-sending are kept in the packet buffer.
+     *
+     * The default implementation returns false.
+     *
+     * @param responseId The value passed to setResponseId() for the response
+     * @return true if the response was written
+     */
+    virtual boolean rewriteResponse(uint8_t responseId);
+
 protected:
 
     /**
@@ -91,6 +189,156 @@ protected:
      */
     virtual void sendInternal(uint16_t length, boolean isReply);
 
+    /**
+     * Check that the packet in the buffer is a valid TCP packet for this server
+     *
+     * @return true if the packet should be processed
+     */
+    boolean validSegment();
+
+    /**
+     * Update the state of the connection, using the TCP packet in the buffer
+     *
+     * @param acceptData false to only process the acknowledgement, without accepting any data
+     * @return true if the packet contains data for the application
+     */
+    boolean processSegment(boolean acceptData);
+
+    /**
+     * Send the data in the buffer to the client of the current connection
+     *
+     * @param flags The TCP flags to set
+     * @param length The length of the data after the TCP header
+     */
+    void sendData(uint8_t flags, uint16_t length);
+
+    /**
+     * Send the segment that has been written so far, and start a new one
+     *
+     * @return false if the connection was closed, or the client stopped acknowledging
+     */
+    boolean sendPartial();
+
+    /**
+     * Process packets until the client's receive window has room for another segment
+     *
+     * @return false if the connection was closed, or timed out
+     */
+    boolean waitForWindow();
+
+    /**
+     * Re-send the segments of any connection whose retransmission timer has expired
+     */
+    void processTimers();
+
+    /**
+     * Re-send the oldest unacknowledged segment of a connection,
+     * or reset the connection if it has been re-sent too many times
+     *
+     * @param conn The connection
+     */
+    void retransmit(struct tcp_connection *conn);
+
+    /**
+     * Ask the application to write the unacknowledged part of a response again
+     *
+     * @param conn The connection
+     * @param length The number of bytes to re-send
+     * @return The number of bytes written to the buffer, or 0 if the
+     *         application couldn't write them
+     */
+    uint16_t rewrite(struct tcp_connection *conn, uint16_t length);
+
+    /**
+     * Update the round-trip time estimates and retransmission timeout
+     * of a connection, using the Jacobson/Karels algorithm (RFC6298)
+     *
+     * @param conn The connection
+     * @param rtt The round-trip time that was measured (in milliseconds)
+     */
+    void updateRoundTripTime(struct tcp_connection *conn, uint16_t rtt);
+
+    /**
+     * Send a segment to the client of a connection
+     *
+     * @param conn The connection
+     * @param flags The TCP flags to set
+     * @param seq The sequence number
+     * @param length The length of the data after the TCP header
+     */
+    void sendConnection(struct tcp_connection *conn, uint8_t flags, uint32_t seq, uint16_t length);
+
+    /**
+     * Get the largest segment that can be sent to the client of a connection
+     *
+     * @param conn The connection
+     * @return the number of bytes
+     */
+    uint16_t segmentSize(struct tcp_connection *conn);
+
+    /**
+     * Get the largest segment that can be sent on the current connection now
+     *
+     * @return the number of bytes
+     */
+    uint16_t segmentLimit();
+
+    /**
+     * Find the connection that the TCP packet in the buffer belongs to
+     *
+     * @return A pointer to the connection, or NULL if there isn't one
+     */
+    struct tcp_connection* findConnection();
+
+    /**
+     * Get a free entry in the connection table, for the TCP packet in the buffer
+     *
+     * If the table is full, the connection that has been idle for longest is
+     * re-used, if it is in the TIME-WAIT state or has timed out.
+     *
+     * @return A pointer to the connection, or NULL if the table is full
+     */
+    struct tcp_connection* newConnection();
+
+    /**
+     * Reply to the TCP packet in the buffer with a segment that has no data
+     *
+     * @param flags The TCP flags to set
+     * @param seq The sequence number
+     * @param ack The acknowledgement number
+     */
+    void sendControl(uint8_t flags, uint32_t seq, uint32_t ack);
+
+    /**
+     * Write the TCP header and send the packet in the buffer
+     *
+     * The packet must be a reply to a TCP packet that was received.
+     *
+     * @param flags The TCP flags to set
+     * @param seq The sequence number
+     * @param ack The acknowledgement number
+     * @param length The length of the data after the TCP header
+     */
+    void sendSegment(uint8_t flags, uint32_t seq, uint32_t ack, uint16_t length);
+
+    /** The table of connections */
+    struct tcp_connection _connections[TCP_CONNECTION_COUNT];
+
+    /** The connection that the last packet accepted by havePacket() belongs to */
+    struct tcp_connection *_connection;
+
+    /** The maximum number of bytes that can be written into the current segment */
+    uint16_t _segmentLimit;
+
+    /** true while rewriteResponse() is being called */
+    boolean _rewriting;
+
+    /** The number of bytes still to be skipped by rewriteResponse() */
+    uint32_t _rewriteSkip;
+
+    /** The number of bytes kept from rewriteResponse() */
+    uint16_t _rewritePos;
+
 };
 
 
@@ -51,6 +51,8 @@ void TFTPServer::handleWriteRequest(int8_t fileno, IPv6Address& address, uint16_
     uint32_t timeout = millis() + TFTP_DATA_TIMEOUT;
     uint16_t expectedBlock = 1;
     while (1) {
+        int32_t remaining = timeout - millis();
+        _ether.waitForPacket(remaining > 0 ? remaining : 0);
         _ether.receivePacket();
 
         if (data.havePacket()) {
@@ -137,6 +139,8 @@ boolean TFTPServer::waitForAck(UDPSocket &sock, uint16_t expectedBlock)
     uint32_t timeout = millis() + TFTP_ACK_TIMEOUT;
 
     do {
+        int32_t remaining = timeout - millis();
+        _ether.waitForPacket(remaining > 0 ? remaining : 0);
         _ether.receivePacket();
 
         if (sock.havePacket()) {
@@ -42,6 +42,11 @@ boolean UDPSocket::havePacket()
         return false;
     }
 
+    if (!_ether.verifyChecksum()) {
+        // Packet is corrupt
+        return false;
+    }
+
     // The packet in the buffer is valid for this socket
     return true;
 }
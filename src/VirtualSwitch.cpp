@@ -0,0 +1,434 @@
+/*
+ * Copyright (c) 2016, Nicholas Humfrey
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * ``AS IS'' AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED.  IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+
+#if !defined(ARDUINO)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "VirtualSwitch.h"
+
+/** Marks a shared switch as ready to use, once the process that created it has set it up */
+#define VSWITCH_MAGIC   (0x45537753)
+
+
+VirtualSwitch::VirtualSwitch()
+{
+    _state = NULL;
+    _shared = false;
+}
+
+VirtualSwitch::~VirtualSwitch()
+{
+    end();
+}
+
+boolean VirtualSwitch::begin(const char *name)
+{
+    if (name == NULL) {
+        _state = (struct vswitch_state*)calloc(1, sizeof(struct vswitch_state));
+        if (_state == NULL) {
+            perror("calloc(vswitch_state)");
+            return false;
+        }
+
+        _shared = false;
+        initialise();
+        return true;
+    }
+
+    // Try and create the switch - otherwise another process got there first
+    boolean created = true;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd == -1 && errno == EEXIST) {
+        created = false;
+        fd = shm_open(name, O_RDWR, 0600);
+    }
+
+    if (fd == -1) {
+        perror("shm_open");
+        return false;
+    }
+
+    if (created) {
+        if (ftruncate(fd, sizeof(struct vswitch_state)) == -1) {
+            perror("ftruncate");
+            close(fd);
+            return false;
+        }
+    } else {
+        // Wait for the other process to set the size
+        struct stat st;
+        st.st_size = 0;
+        for (uint8_t i = 0; i < 100; i++) {
+            if (fstat(fd, &st) == 0 && st.st_size != 0) {
+                break;
+            }
+            usleep(10000);
+        }
+
+        if (st.st_size != sizeof(struct vswitch_state)) {
+            fprintf(stderr, "Shared VirtualSwitch %s was built with different settings\n", name);
+            close(fd);
+            return false;
+        }
+    }
+
+    void *mapped = mmap(NULL, sizeof(struct vswitch_state), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        perror("mmap(vswitch_state)");
+        return false;
+    }
+
+    _state = (struct vswitch_state*)mapped;
+    _shared = true;
+
+    if (created) {
+        initialise();
+    } else {
+        for (uint8_t i = 0; i < 100 && __atomic_load_n(&_state->magic, __ATOMIC_ACQUIRE) != VSWITCH_MAGIC; i++) {
+            usleep(10000);
+        }
+
+        if (_state->magic != VSWITCH_MAGIC) {
+            fprintf(stderr, "Shared VirtualSwitch %s was never set up\n", name);
+            end();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void VirtualSwitch::initialise()
+{
+    pthread_mutexattr_t mutexattr;
+    pthread_mutexattr_init(&mutexattr);
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    if (_shared) {
+        pthread_mutexattr_setpshared(&mutexattr, PTHREAD_PROCESS_SHARED);
+        pthread_condattr_setpshared(&condattr, PTHREAD_PROCESS_SHARED);
+    }
+
+    pthread_mutex_init(&_state->lock, &mutexattr);
+    for (uint16_t i = 0; i < VSWITCH_MAX_PORTS; i++) {
+        _state->ports[i].inUse = false;
+        _state->ports[i].head = 0;
+        _state->ports[i].count = 0;
+        pthread_cond_init(&_state->ports[i].arrived, &condattr);
+    }
+
+    for (uint16_t i = 0; i < VSWITCH_MAC_TABLE_SIZE; i++) {
+        _state->macTable[i].used = false;
+    }
+
+    _state->forwarded = 0;
+    _state->flooded = 0;
+    _state->dropped = 0;
+
+    pthread_mutexattr_destroy(&mutexattr);
+    pthread_condattr_destroy(&condattr);
+
+    __atomic_store_n(&_state->magic, VSWITCH_MAGIC, __ATOMIC_RELEASE);
+}
+
+void VirtualSwitch::end()
+{
+    if (_state == NULL) {
+        return;
+    }
+
+    if (_shared) {
+        munmap(_state, sizeof(struct vswitch_state));
+    } else {
+        for (uint16_t i = 0; i < VSWITCH_MAX_PORTS; i++) {
+            pthread_cond_destroy(&_state->ports[i].arrived);
+        }
+        pthread_mutex_destroy(&_state->lock);
+        free(_state);
+    }
+
+    _state = NULL;
+}
+
+void VirtualSwitch::remove(const char *name)
+{
+    shm_unlink(name);
+}
+
+/*---------------------------------------------------------------------------*/
+
+int16_t VirtualSwitch::attach()
+{
+    int16_t result = -1;
+
+    pthread_mutex_lock(&_state->lock);
+    for (uint16_t i = 0; i < VSWITCH_MAX_PORTS; i++) {
+        struct vswitch_port *port = &_state->ports[i];
+        if (!port->inUse) {
+            port->inUse = true;
+            port->head = 0;
+            port->count = 0;
+            result = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&_state->lock);
+
+    return result;
+}
+
+void VirtualSwitch::detach(uint16_t port)
+{
+    pthread_mutex_lock(&_state->lock);
+    _state->ports[port].inUse = false;
+    _state->ports[port].count = 0;
+
+    // Forget the addresses on the port, so that frames for them are flooded
+    for (uint16_t i = 0; i < VSWITCH_MAC_TABLE_SIZE; i++) {
+        if (_state->macTable[i].port == port + 1) {
+            _state->macTable[i].port = 0;
+        }
+    }
+    pthread_mutex_unlock(&_state->lock);
+}
+
+struct vswitch_mac_entry* VirtualSwitch::lookup(const uint8_t *mac)
+{
+    // The last bytes of a MAC address are the most likely to differ
+    uint16_t hash = ((mac[3] << 8) ^ (mac[4] << 4) ^ mac[5]) & (VSWITCH_MAC_TABLE_SIZE - 1);
+
+    for (uint16_t i = 0; i < VSWITCH_MAC_TABLE_SIZE; i++) {
+        struct vswitch_mac_entry *entry = &_state->macTable[(hash + i) & (VSWITCH_MAC_TABLE_SIZE - 1)];
+        if (!entry->used || memcmp(entry->mac, mac, 6) == 0) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
+void VirtualSwitch::learn(const uint8_t *mac, uint16_t port)
+{
+    struct vswitch_mac_entry *entry = lookup(mac);
+    if (entry) {
+        entry->used = true;
+        memcpy(entry->mac, mac, 6);
+        entry->port = port + 1;
+    }
+}
+
+void VirtualSwitch::enqueue(struct vswitch_port *port, const uint8_t *frame, uint16_t length)
+{
+    if (port->count == VSWITCH_QUEUE_SIZE) {
+        _state->dropped++;
+        return;
+    }
+
+    struct vswitch_frame *slot = &port->queue[(port->head + port->count) % VSWITCH_QUEUE_SIZE];
+    memcpy(slot->data, frame, length);
+    slot->length = length;
+    port->count++;
+
+    pthread_cond_signal(&port->arrived);
+}
+
+void VirtualSwitch::forward(uint16_t port, const uint8_t *frame, uint16_t length)
+{
+    const uint8_t *destination = &frame[0];
+    const uint8_t *source = &frame[6];
+
+    if (length < 14 || length > ETHERSIA_MAX_PACKET_SIZE) {
+        return;
+    }
+
+    pthread_mutex_lock(&_state->lock);
+
+    // Multicast addresses can't be learned
+    if ((source[0] & 0x01) == 0) {
+        learn(source, port);
+    }
+
+    struct vswitch_mac_entry *entry = NULL;
+    if ((destination[0] & 0x01) == 0) {
+        entry = lookup(destination);
+    }
+
+    if (entry && entry->used && entry->port) {
+        uint16_t to = entry->port - 1;
+        if (to != port && _state->ports[to].inUse) {
+            enqueue(&_state->ports[to], frame, length);
+        }
+        _state->forwarded++;
+    } else {
+        // Multicast, or we don't know where the destination is yet
+        for (uint16_t i = 0; i < VSWITCH_MAX_PORTS; i++) {
+            if (i != port && _state->ports[i].inUse) {
+                enqueue(&_state->ports[i], frame, length);
+            }
+        }
+        _state->flooded++;
+    }
+
+    pthread_mutex_unlock(&_state->lock);
+}
+
+uint16_t VirtualSwitch::receive(uint16_t port, uint8_t *buffer, uint16_t bufsize)
+{
+    struct vswitch_port *p = &_state->ports[port];
+    uint16_t length = 0;
+
+    pthread_mutex_lock(&_state->lock);
+    while (p->count > 0 && length == 0) {
+        struct vswitch_frame *slot = &p->queue[p->head];
+        p->head = (p->head + 1) % VSWITCH_QUEUE_SIZE;
+        p->count--;
+
+        // Frames that don't fit in the buffer are skipped
+        if (slot->length <= bufsize) {
+            memcpy(buffer, slot->data, slot->length);
+            length = slot->length;
+        }
+    }
+    pthread_mutex_unlock(&_state->lock);
+
+    return length;
+}
+
+boolean VirtualSwitch::wait(uint16_t port, uint16_t timeout)
+{
+    struct vswitch_port *p = &_state->ports[port];
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&_state->lock);
+    while (p->count == 0 && timeout > 0) {
+        if (pthread_cond_timedwait(&p->arrived, &_state->lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    boolean result = (p->count > 0);
+    pthread_mutex_unlock(&_state->lock);
+
+    return result;
+}
+
+uint32_t VirtualSwitch::framesForwarded()
+{
+    return _state->forwarded;
+}
+
+uint32_t VirtualSwitch::framesFlooded()
+{
+    return _state->flooded;
+}
+
+uint32_t VirtualSwitch::framesDropped()
+{
+    return _state->dropped;
+}
+
+/*---------------------------------------------------------------------------*/
+
+EtherSia_VirtualSwitch::EtherSia_VirtualSwitch(VirtualSwitch &vswitch)
+    : _vswitch(vswitch)
+{
+    _port = -1;
+}
+
+boolean EtherSia_VirtualSwitch::begin(const MACAddress &address)
+{
+    _localMac = address;
+
+    _port = _vswitch.attach();
+    if (_port < 0) {
+        fprintf(stderr, "No free ports on the VirtualSwitch\n");
+        return false;
+    }
+
+    return EtherSia::begin();
+}
+
+uint16_t EtherSia_VirtualSwitch::sendFrame(const uint8_t *data, uint16_t datalen)
+{
+    if (_port < 0) {
+        return 0;
+    }
+
+    _vswitch.forward(_port, data, datalen);
+    return datalen;
+}
+
+uint16_t EtherSia_VirtualSwitch::readFrame(uint8_t *buffer, uint16_t bufsize)
+{
+    if (_port < 0) {
+        return 0;
+    }
+
+    return _vswitch.receive(_port, buffer, bufsize);
+}
+
+boolean EtherSia_VirtualSwitch::waitForFrame(uint16_t timeout)
+{
+    if (_port < 0) {
+        return false;
+    }
+
+    return _vswitch.wait(_port, timeout);
+}
+
+void EtherSia_VirtualSwitch::end()
+{
+    if (_port >= 0) {
+        _vswitch.detach(_port);
+        _port = -1;
+    }
+}
+
+#endif
@@ -0,0 +1,279 @@
+/**
+ * Header file for connecting EtherSia instances together with a virtual switch
+ * @file VirtualSwitch.h
+ */
+
+#ifndef VIRTUALSWITCH_H
+#define VIRTUALSWITCH_H
+
+#include <pthread.h>
+
+#include "EtherSia.h"
+
+/**
+ * The maximum number of EtherSia instances that can be connected to a VirtualSwitch
+ */
+#ifndef VSWITCH_MAX_PORTS
+#define VSWITCH_MAX_PORTS       (512)
+#endif
+
+/**
+ * The number of frames that can be waiting to be read on each port
+ * Frames forwarded to a port with a full queue are dropped.
+ */
+#ifndef VSWITCH_QUEUE_SIZE
+#define VSWITCH_QUEUE_SIZE      (8)
+#endif
+
+/**
+ * The number of MAC addresses that a VirtualSwitch can learn
+ * Must be a power of two.
+ */
+#ifndef VSWITCH_MAC_TABLE_SIZE
+#define VSWITCH_MAC_TABLE_SIZE  (1024)
+#endif
+
+/**
+ * A frame waiting in the queue of a VirtualSwitch port
+ * @private
+ */
+struct vswitch_frame {
+    uint16_t length;
+    uint8_t data[ETHERSIA_MAX_PACKET_SIZE];
+};
+
+/**
+ * A port on a VirtualSwitch
+ * @private
+ */
+struct vswitch_port {
+    boolean inUse;
+    uint16_t head;
+    uint16_t count;
+    pthread_cond_t arrived;
+    struct vswitch_frame queue[VSWITCH_QUEUE_SIZE];
+};
+
+/**
+ * An entry in the MAC address table of a VirtualSwitch
+ * @private
+ */
+struct vswitch_mac_entry {
+    boolean used;
+    uint8_t mac[6];
+    uint16_t port;      ///< The port number plus one, or 0 if the port has gone
+};
+
+/**
+ * Everything belonging to a VirtualSwitch, which may be in shared memory
+ * @private
+ */
+struct vswitch_state {
+    uint32_t magic;
+    pthread_mutex_t lock;
+    uint32_t forwarded;
+    uint32_t flooded;
+    uint32_t dropped;
+    struct vswitch_mac_entry macTable[VSWITCH_MAC_TABLE_SIZE];
+    struct vswitch_port ports[VSWITCH_MAX_PORTS];
+};
+
+/**
+ * A virtual Ethernet switch, for simulating a network of EtherSia nodes
+ *
+ * Frames sent by an EtherSia_VirtualSwitch are delivered to the port that
+ * the destination MAC address was last seen on. Multicast frames, and
+ * frames for addresses that haven't been seen yet, are sent to every port.
+ *
+ * The switch can either be private to one process, with a node on each
+ * thread, or shared between several processes using POSIX shared memory.
+ *
+ * @note Not intended for use with running EtherSia on Arduino.
+ */
+class VirtualSwitch {
+
+public:
+    /**
+     * Constructor
+     */
+    VirtualSwitch();
+
+    /**
+     * Destructor
+     */
+    ~VirtualSwitch();
+
+    /**
+     * Create the switch, or connect to a switch in another process
+     *
+     * @param name the name of the POSIX shared memory object (such as "/ethersia"),
+     *             or NULL to create a switch that is private to this process
+     * @return true if successful
+     */
+    boolean begin(const char *name = NULL);
+
+    /**
+     * Disconnect from the switch, and free it if it is private to this process
+     * Any EtherSia_VirtualSwitch using the switch must have been ended first.
+     */
+    void end();
+
+    /**
+     * Remove a shared switch, so that the next begin() creates a new one
+     *
+     * @param name the name of the POSIX shared memory object
+     */
+    static void remove(const char *name);
+
+    /**
+     * Connect a new port to the switch
+     *
+     * @return the port number, or -1 if all the ports are in use
+     */
+    int16_t attach();
+
+    /**
+     * Disconnect a port from the switch, discarding any frames waiting on it
+     *
+     * @param port the port number returned by attach()
+     */
+    void detach(uint16_t port);
+
+    /**
+     * Send a frame into the switch
+     *
+     * The source MAC address of the frame is learned for the port.
+     *
+     * @param port the port number that the frame was sent from
+     * @param frame a pointer to the Ethernet frame
+     * @param length the length of the frame
+     */
+    void forward(uint16_t port, const uint8_t *frame, uint16_t length);
+
+    /**
+     * Take the next frame waiting on a port
+     *
+     * @param port the port number to read from
+     * @param buffer a pointer to a buffer to write the frame to
+     * @param bufsize the available space in the buffer
+     * @return the length of the frame, or 0 if no frames are waiting
+     */
+    uint16_t receive(uint16_t port, uint8_t *buffer, uint16_t bufsize);
+
+    /**
+     * Wait for a frame to arrive on a port
+     *
+     * @param port the port number to wait on
+     * @param timeout the maximum time to wait (in milliseconds)
+     * @return true if there is a frame waiting on the port
+     */
+    boolean wait(uint16_t port, uint16_t timeout);
+
+    /**
+     * Get the number of frames that were sent to a single port
+     * @return the number of frames
+     */
+    uint32_t framesForwarded();
+
+    /**
+     * Get the number of frames that were sent to every port
+     * @return the number of frames
+     */
+    uint32_t framesFlooded();
+
+    /**
+     * Get the number of frames that were dropped, because a port's queue was full
+     * @return the number of frames
+     */
+    uint32_t framesDropped();
+
+protected:
+    /**
+     * Set up the mutex, condition variables and MAC table of a new switch
+     */
+    void initialise();
+
+    /**
+     * Remember which port a MAC address was seen on
+     */
+    void learn(const uint8_t *mac, uint16_t port);
+
+    /**
+     * Find the entry in the MAC address table for a MAC address
+     * @return a pointer to the entry, or the empty entry where it should go,
+     *         or NULL if it isn't in the table and the table is full
+     */
+    struct vswitch_mac_entry* lookup(const uint8_t *mac);
+
+    /**
+     * Add a frame to the queue of a port
+     */
+    void enqueue(struct vswitch_port *port, const uint8_t *frame, uint16_t length);
+
+    struct vswitch_state *_state;
+    boolean _shared;
+};
+
+
+/**
+ * Run EtherSia connected to a port on a VirtualSwitch
+ * Not intended for use with running EtherSia on Arduino.
+ *
+ * Many of these can run in the same process, on different threads,
+ * to simulate a network without needing root or a real network interface.
+ */
+class EtherSia_VirtualSwitch : public EtherSia {
+
+public:
+    /**
+     * Constructor
+     * @param vswitch the VirtualSwitch to connect to
+     */
+    EtherSia_VirtualSwitch(VirtualSwitch &vswitch);
+
+    // Tell the compiler we want to use begin() from the base class
+    using EtherSia::begin;
+
+    /**
+     * Connect to a port on the switch and initialise EtherSia
+     *
+     * @param address the local MAC address for the virtual interface
+     * @return Returns true if setting up the virtual interface was successful
+     */
+    virtual boolean begin(const MACAddress &address);
+
+    /**
+     * Send an Ethernet frame
+     * @param data a pointer to the data to send
+     * @param datalen the length of the data in the packet
+     * @return the number of bytes transmitted
+     */
+    virtual uint16_t sendFrame(const uint8_t *data, uint16_t datalen);
+
+    /**
+     * Read an Ethernet frame
+     * @param buffer a pointer to a buffer to write the packet to
+     * @param bufsize the available space in the buffer
+     * @return the length of the received packet
+     *         or 0 if no packet was received
+     */
+    virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
+
+    /**
+     * Sleep until a frame arrives on our port of the switch
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return false if the timeout expired without a frame arriving
+     */
+    virtual boolean waitForFrame(uint16_t timeout);
+
+    /**
+     * Disconnect from the switch
+     */
+    virtual void end();
+
+protected:
+    VirtualSwitch &_vswitch;
+    int16_t _port;
+};
+
+#endif /* VIRTUALSWITCH_H */
@@ -160,6 +160,10 @@ IPv6Address* EtherSia::lookupHostname(const char* hostname)
         }
 
         // Have we received a reply?
+        if (requestCount <= DNS_REQUEST_ATTEMPTS) {
+            long remaining = (long)(nextRequest - millis());
+            waitForPacket(remaining > 0 ? remaining : 0);
+        }
         receivePacket();
         if (udp.havePacket()) {
             IPv6Address *address = dnsProcessReply(udp.payload(), udp.payloadLength(), id);
@@ -102,6 +102,13 @@ EtherSia_Dummy::readFrame(uint8_t *buffer, uint16_t bufsize)
     }
 }
 
+boolean
+EtherSia_Dummy::waitForFrame(uint16_t timeout)
+{
+    (void)timeout;
+    return _recievedCount < _injectCount;
+}
+
 
 frame_t&
 EtherSia_Dummy::getSent(size_t pos)
@@ -65,6 +65,15 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
 
+    /**
+     * Check if there is an injected packet waiting to be read
+     * The dummy driver never sleeps, whatever the timeout is.
+     *
+     * @param timeout The maximum time to wait (in milliseconds)
+     * @return true if there is an injected packet waiting
+     */
+    virtual boolean waitForFrame(uint16_t timeout);
+
     /**
      * Close the dummy ethernet socket
      *
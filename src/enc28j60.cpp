@@ -72,6 +72,9 @@ void serial_printf(const char *fmt, ...) {
 #define ECON2_AUTOINC 0x80
 #define ECON2_PKTDEC  0x40
 
+#define EIE_INTIE     0x80
+#define EIE_PKTIE     0x40
+
 #define EIR_TXIF      0x08
 
 #define ERXTX_BANK 0x00
@@ -142,10 +145,20 @@ void serial_printf(const char *fmt, ...) {
 // The ENC28J60 SPI Interface supports clock speeds up to 20 MHz
 static const SPISettings spiSettings(20000000, MSBFIRST, SPI_MODE0);
 
+volatile boolean EtherSia_ENC28J60::_interruptPending = false;
+
 EtherSia_ENC28J60::EtherSia_ENC28J60(int8_t cs)
 {
     _cs = cs;
     _bank = ERXTX_BANK;
+    _framesPending = 0;
+    _intPin = -1;
+}
+
+void
+EtherSia_ENC28J60::interruptHandler()
+{
+    _interruptPending = true;
 }
 
 void
@@ -233,6 +246,10 @@ EtherSia_ENC28J60::clearregbitfield(uint8_t reg, uint8_t mask)
 void
 EtherSia_ENC28J60::setregbank(uint8_t new_bank)
 {
+    if(new_bank == _bank) {
+        /* Save a read-modify-write of ECON1 */
+        return;
+    }
     writereg(ECON1, (readreg(ECON1) & 0xfc) | (new_bank & 0x03));
     _bank = new_bank;
 }
@@ -287,6 +304,7 @@ EtherSia_ENC28J60::softreset(void)
     SPI.transfer(0xff);
     enc28j60_arch_spi_deselect();
     _bank = ERXTX_BANK;
+    _framesPending = 0;
 }
 
 /*---------------------------------------------------------------------------*/
@@ -511,8 +529,9 @@ EtherSia_ENC28J60::reset(void)
     /* Turn on autoincrement for buffer access */
     setregbitfield(ECON2, ECON2_AUTOINC);
 
-    /* Turn on reception */
+    /* Turn on reception (this also selects bank 0) */
     writereg(ECON1, ECON1_RXEN);
+    _bank = ERXTX_BANK;
 }
 /*---------------------------------------------------------------------------*/
 boolean
@@ -524,6 +543,15 @@ EtherSia_ENC28J60::begin(const MACAddress &address)
 
     PRINTF("ENC28J60 rev. B%d\n", readrev());
 
+    if(_intPin >= 0) {
+        /* Assert INT while there are packets waiting */
+        setregbitfield(EIE, EIE_INTIE | EIE_PKTIE);
+
+        pinMode(_intPin, INPUT);
+        _interruptPending = true;
+        attachInterrupt(digitalPinToInterrupt(_intPin), interruptHandler, FALLING);
+    }
+
     return EtherSia::begin();
 }
 
@@ -616,77 +644,111 @@ uint16_t
 EtherSia_ENC28J60::readFrame(uint8_t *buffer, uint16_t bufsize)
 {
     uint16_t len, next;
-    uint8_t n, err;
+    uint8_t n, accept;
 
     uint8_t nxtpkt[2];
     uint8_t status[2];
     uint8_t length[2];
 
-    err = 0;
-
-    setregbank(EPKTCNT_BANK);
-    n = readreg(EPKTCNT);
-
-    if(n == 0) {
-        return 0;
-    }
-
-    PRINTF("enc28j60: EPKTCNT 0x%02x\n", n);
-
-    setregbank(ERXTX_BANK);
-    /* Read the next packet pointer */
-    nxtpkt[0] = readdatabyte();
-    nxtpkt[1] = readdatabyte();
-
-    PRINTF("enc28j60: nxtpkt 0x%02x%02x\n", nxtpkt[1], nxtpkt[0]);
-
-    length[0] = readdatabyte();
-    length[1] = readdatabyte();
-
-    PRINTF("enc28j60: length 0x%02x%02x\n", length[1], length[0]);
-
-    status[0] = readdatabyte();
-    status[1] = readdatabyte();
-
-    /* This statement is just to avoid a compiler warning: */
-    status[0] = status[0];
-    PRINTF("enc28j60: status 0x%02x%02x\n", status[1], status[0]);
-
-    len = (length[1] << 8) + length[0];
-    if(bufsize >= len) {
-        readdata(buffer, len);
-    } else {
-        uint16_t i;
+    /* Keep going until we find a frame we want, or run out of frames */
+    while(1) {
+        if(_framesPending == 0) {
+            if(_intPin >= 0) {
+                if(!_interruptPending) {
+                    /* INT hasn't signalled - don't touch the SPI bus */
+                    return 0;
+                }
+
+                /* Clear the flag before checking, so a packet arriving now isn't missed */
+                _interruptPending = false;
+            }
+
+            /* Only check EPKTCNT once the frames counted last time have been read.
+               Within a burst this keeps us in bank 0, and ERDPT is already
+               pointing at the next frame. */
+            setregbank(EPKTCNT_BANK);
+            n = readreg(EPKTCNT);
+
+            if(n == 0) {
+                return 0;
+            }
+
+            PRINTF("enc28j60: EPKTCNT 0x%02x\n", n);
+            _framesPending = n;
+
+            /* INT stays low until EPKTCNT reaches 0, so there won't be another
+               falling edge for packets arriving in the meantime - check again */
+            _interruptPending = true;
+        }
+        _framesPending--;
+
+        setregbank(ERXTX_BANK);
+        /* Read the next packet pointer */
+        nxtpkt[0] = readdatabyte();
+        nxtpkt[1] = readdatabyte();
+
+        PRINTF("enc28j60: nxtpkt 0x%02x%02x\n", nxtpkt[1], nxtpkt[0]);
+
+        length[0] = readdatabyte();
+        length[1] = readdatabyte();
+
+        PRINTF("enc28j60: length 0x%02x%02x\n", length[1], length[0]);
+
+        status[0] = readdatabyte();
+        status[1] = readdatabyte();
+
+        /* This statement is just to avoid a compiler warning: */
+        status[0] = status[0];
+        PRINTF("enc28j60: status 0x%02x%02x\n", status[1], status[0]);
+
+        len = (length[1] << 8) + length[0];
+        next = (nxtpkt[1] << 8) + nxtpkt[0];
+        accept = 1;
+
+        if(bufsize < len) {
+            PRINTF("enc28j60: rx err: too big %d\n", len);
+            accept = 0;
+        } else if(len > sizeof(IPv6Packet)) {
+            /* Read just the headers first, so that we don't copy
+               frames that aren't for us over SPI */
+            readdata(buffer, sizeof(IPv6Packet));
+            if(filterPacket((IPv6Packet&)*buffer)) {
+                readdata(buffer + sizeof(IPv6Packet), len - sizeof(IPv6Packet));
+            } else {
+                PRINTF("enc28j60: rx filtered: %d\n", len);
+                accept = 0;
+            }
+        } else {
+            readdata(buffer, len);
+        }
 
-        err = 1;
+        if(accept) {
+            /* Read an additional byte at odd lengths, to avoid FIFO corruption */
+            if((len % 2) != 0) {
+                readdatabyte();
+            }
+        } else {
+            /* Skip the rest of the frame, by moving the read pointer to the next one */
+            writereg(ERDPTL, next & 0xff);
+            writereg(ERDPTH, next >> 8);
+        }
 
-        /* flush rx fifo */
-        for(i = 0; i < len; i++) {
-            readdatabyte();
+        /* Errata #14 */
+        if(next == RX_BUF_START) {
+            next = RX_BUF_END;
+        } else {
+            next = next - 1;
         }
-    }
+        writereg(ERXRDPTL, next & 0xff);
+        writereg(ERXRDPTH, next >> 8);
 
-    /* Read an additional byte at odd lengths, to avoid FIFO corruption */
-    if((len % 2) != 0) {
-        readdatabyte();
-    }
+        setregbitfield(ECON2, ECON2_PKTDEC);
 
-    /* Errata #14 */
-    next = (nxtpkt[1] << 8) + nxtpkt[0];
-    if(next == RX_BUF_START) {
-        next = RX_BUF_END;
-    } else {
-        next = next - 1;
+        if(accept) {
+            break;
+        }
     }
-    writereg(ERXRDPTL, next & 0xff);
-    writereg(ERXRDPTH, next >> 8);
-
-    setregbitfield(ECON2, ECON2_PKTDEC);
 
-    if(err) {
-        PRINTF("enc28j60: rx err: flushed %d\n", len);
-        return 0;
-    }
     PRINTF("enc28j60: rx: %d: %02x:%02x:%02x:%02x:%02x:%02x\n", len,
            0xff & buffer[0], 0xff & buffer[1], 0xff & buffer[2],
            0xff & buffer[3], 0xff & buffer[4], 0xff & buffer[5]);
@@ -82,6 +82,19 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
 
+    /**
+     * Use the ENC28J60's INT pin to find out when frames have arrived
+     *
+     * Call this before begin(). readFrame() then returns straight away,
+     * without any SPI traffic, until the INT pin signals that a frame is waiting.
+     *
+     * @note Only one ENC28J60 can use its interrupt pin at a time
+     * @param pin The Arduino pin that INT is connected to (must support attachInterrupt())
+     */
+    inline void setInterruptPin(int8_t pin) {
+        _intPin = pin;
+    }
+
 private:
 
     uint8_t is_mac_mii_reg(uint8_t reg);
@@ -110,6 +123,18 @@ private:
     uint8_t _bank;
     int8_t _cs;
 
+    /** Number of frames counted in EPKTCNT that haven't been read yet */
+    uint8_t _framesPending;
+
+    /** The pin connected to INT, or -1 to poll EPKTCNT */
+    int8_t _intPin;
+
+    /** Flag set by the interrupt handler when the INT pin has signalled */
+    static volatile boolean _interruptPending;
+
+    /** Interrupt handler for the INT pin */
+    static void interruptHandler();
+
 };
 
 #endif /* ENC28J60_H */
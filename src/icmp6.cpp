@@ -6,7 +6,7 @@
 
 void EtherSia::icmp6ErrorReply(uint8_t type, uint8_t code)
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
     uint16_t payloadLen = IP6_HEADER_LEN + packet.payloadLength();
     const uint16_t payloadMax = ETHERSIA_MAX_PACKET_SIZE - ICMP6_ERROR_HEADER_OFFSET - ICMP6_ERROR_HEADER_LEN;
 
@@ -40,7 +40,7 @@ void EtherSia::icmp6ErrorReply(uint8_t type, uint8_t code)
 
 void EtherSia::icmp6NSReply()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
 
     // Does the Neighbour Solicitation target belong to us?
     uint8_t type = isOurAddress(packet.ns.target);
@@ -48,6 +48,13 @@ void EtherSia::icmp6NSReply()
         return;
     }
 
+    // Remember the link-layer address of the sender, if it told us
+    if (!packet.source().isZero() &&
+            packet.payloadLength() >= ICMP6_HEADER_LEN + ICMP6_NS_HEADER_LEN &&
+            packet.ns.option1.type == ICMP6_OPTION_SOURCE_LINK_ADDRESS) {
+        icmp6NeighbourSeen(packet.source(), packet.ns.option1.mac);
+    }
+
     prepareReply();
     packet.setHopLimit(255);
 
@@ -68,18 +75,26 @@ void EtherSia::icmp6NSReply()
 
 void EtherSia::icmp6EchoReply()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
+    uint16_t oldAddressSum = packet.addressSum();
+    uint16_t oldTypeCode = bytesToWord(packet.type, packet.code);
+
     prepareReply();
 
     packet.type = ICMP6_TYPE_ECHO_REPLY;
     packet.code = 0;
 
-    icmp6PacketSend();
+    // The payload is echoed back unchanged, so only adjust the checksum
+    // for the new addresses and type, rather than re-calculating it
+    packet.checksum = IPv6Packet::adjustChecksum(packet.checksum, oldAddressSum, packet.addressSum());
+    packet.checksum = IPv6Packet::adjustChecksum(packet.checksum, oldTypeCode, bytesToWord(packet.type, packet.code));
+
+    send();
 }
 
 void EtherSia::icmp6SendNS(IPv6Address &targetAddress, IPv6Address &sourceAddress)
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
 
     packet.destination().setSolicitedNodeMulticastAddress(targetAddress);
     packet.etherDestination().setIPv6Multicast(packet.destination());
@@ -108,7 +123,7 @@ void EtherSia::icmp6SendNS(IPv6Address &targetAddress, IPv6Address &sourceAddres
 
 void EtherSia::icmp6SendRS()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
 
     prepareSend();
     packet.setPayloadLength(ICMP6_HEADER_LEN + ICMP6_RS_HEADER_LEN);
@@ -130,7 +145,7 @@ void EtherSia::icmp6SendRS()
 
 void EtherSia::icmp6PacketSend()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
 
     packet.setProtocol(IP6_PROTO_ICMP6);
     packet.checksum = 0;
@@ -164,7 +179,7 @@ void EtherSia::icmp6ProcessPrefix(struct icmp6_prefix_information *pi)
 
 void EtherSia::icmp6ProcessRA()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
     int16_t remaining = packet.payloadLength() - ICMP6_HEADER_LEN - ICMP6_RA_HEADER_LEN;
     uint8_t *ptr = _buffer + ICMP6_RA_HEADER_OFFSET + ICMP6_RA_HEADER_LEN;
 
@@ -177,6 +192,7 @@ void EtherSia::icmp6ProcessRA()
         case ICMP6_OPTION_SOURCE_LINK_ADDRESS:
             // Store the MAC address of the router
             _routerMac = *((MACAddress*)&ptr[2]);
+            icmp6NeighbourSeen(packet.source(), _routerMac);
             break;
         case ICMP6_OPTION_PREFIX_INFORMATION:
             icmp6ProcessPrefix(
@@ -199,24 +215,49 @@ void EtherSia::icmp6ProcessRA()
     }
 }
 
-MACAddress* EtherSia::icmp6ProcessNA(IPv6Address &expected)
+void EtherSia::icmp6NeighbourSeen(IPv6Address &address, MACAddress &mac)
+{
+    struct neighbour_entry *entry = neighbourCacheLookup(address);
+
+    // A new or different link-layer address hasn't been confirmed as reachable yet
+    if (entry == NULL || entry->state == NEIGHBOUR_STATE_INCOMPLETE || entry->mac != mac) {
+        neighbourCacheUpdate(address, &mac, NEIGHBOUR_STATE_STALE);
+    }
+}
+
+void EtherSia::icmp6ProcessNA()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
-    if (packet.na.target != expected) {
-        return NULL;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
+    struct neighbour_entry *entry = neighbourCacheLookup(packet.na.target);
+    MACAddress *mac;
+
+    // Unsolicited advertisements for neighbours we don't know about are ignored
+    if (entry == NULL) {
+        return;
     }
 
     // Check for option
     if (packet.na.option1.type == ICMP6_OPTION_TARGET_LINK_ADDRESS) {
-        return &(packet.na.option1.mac);
+        mac = &(packet.na.option1.mac);
     } else {
-        return &(packet.etherSource());
+        mac = &(packet.etherSource());
+    }
+
+    if (entry->state == NEIGHBOUR_STATE_INCOMPLETE || entry->mac == *mac ||
+            (packet.na.flags & ICMP6_NA_FLAG_O)) {
+        neighbourCacheUpdate(
+            packet.na.target, mac,
+            (packet.na.flags & ICMP6_NA_FLAG_S) ? NEIGHBOUR_STATE_REACHABLE : NEIGHBOUR_STATE_STALE
+        );
+    } else if (entry->state == NEIGHBOUR_STATE_REACHABLE) {
+        // Different address without the Override flag: stop trusting the cached one
+        entry->state = NEIGHBOUR_STATE_STALE;
     }
 }
 
 boolean EtherSia::icmp6ProcessPacket()
 {
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
+    ICMPv6Packet& packet = (ICMPv6Packet&)*_buffer;
 
     if (isOurAddress(packet.destination()) == 0) {
         // Packet isn't addressed to us
@@ -236,6 +277,10 @@ boolean EtherSia::icmp6ProcessPacket()
         icmp6ProcessRA();
         return true;
 
+    case ICMP6_TYPE_NA:
+        icmp6ProcessNA();
+        return true;
+
     default:
         // We didn't handle the packet
         return false;
@@ -253,6 +298,11 @@ boolean EtherSia::icmp6AutoConfigure()
             count++;
         }
 
+        // Sleep until a packet arrives or the next Router Solicitation is due
+        if (count <= ROUTER_SOLICITATION_ATTEMPTS) {
+            long remaining = (long)(nextRouterSolicitation - millis());
+            waitForPacket(remaining > 0 ? remaining : 0);
+        }
         receivePacket();
 
         if (count > ROUTER_SOLICITATION_ATTEMPTS) {
@@ -263,44 +313,3 @@ boolean EtherSia::icmp6AutoConfigure()
     // We have a global IPv6 address - success
     return true;
 }
-
-MACAddress* EtherSia::discoverNeighbour(const char* addrstr)
-{
-    IPv6Address addr(addrstr);
-    return discoverNeighbour(addr);
-}
-
-MACAddress* EtherSia::discoverNeighbour(IPv6Address& address, uint8_t attempts)
-{
-    ICMPv6Packet& packet = (ICMPv6Packet&)_ptr;
-    IPv6Address *sourceAddress = NULL;
-    unsigned long nextNeighbourSolicitation = millis();
-    uint8_t count = 0;
-
-    // Work out the source address to send the Neighbour Solicitation from
-    if (address.isLinkLocal()) {
-        sourceAddress = &_linkLocalAddress;
-    } else {
-        sourceAddress = &_globalAddress;
-    }
-
-    while (count < attempts) {
-        if ((long)(millis() - nextNeighbourSolicitation) >= 0) {
-            icmp6SendNS(address, *sourceAddress);
-            nextNeighbourSolicitation = millis() + NEIGHBOUR_SOLICITATION_TIMEOUT;
-            count++;
-        }
-
-        uint16_t len = receivePacket();
-        if (len) {
-            if (packet.protocol() == IP6_PROTO_ICMP6 && packet.type == ICMP6_TYPE_NA) {
-                MACAddress* neighbourMac = icmp6ProcessNA(address);
-                if (neighbourMac) {
-                    return neighbourMac;
-                }
-            }
-        }
-    }
-
-    return NULL;
-}
@@ -0,0 +1,222 @@
+#include "EtherSia.h"
+#include "neighbour.h"
+
+
+struct neighbour_entry* EtherSia::neighbourCacheLookup(const IPv6Address &address)
+{
+    for (uint8_t i = 0; i < NEIGHBOUR_CACHE_SIZE; i++) {
+        struct neighbour_entry *entry = &_neighbourCache[i];
+        if (entry->state == NEIGHBOUR_STATE_EMPTY || entry->address != address) {
+            continue;
+        }
+
+        // Reachability confirmations expire after a while
+        if (entry->state == NEIGHBOUR_STATE_REACHABLE &&
+                (unsigned long)(millis() - entry->timestamp) > NEIGHBOUR_REACHABLE_TIME) {
+            entry->state = NEIGHBOUR_STATE_STALE;
+        }
+
+        return entry;
+    }
+
+    return NULL;
+}
+
+struct neighbour_entry* EtherSia::neighbourCacheUpdate(const IPv6Address &address, const MACAddress *mac, uint8_t state)
+{
+    struct neighbour_entry *entry = neighbourCacheLookup(address);
+
+    if (entry == NULL) {
+        // Use an empty entry, or replace the one that was confirmed longest ago
+        entry = &_neighbourCache[0];
+        for (uint8_t i = 0; i < NEIGHBOUR_CACHE_SIZE; i++) {
+            if (_neighbourCache[i].state == NEIGHBOUR_STATE_EMPTY) {
+                entry = &_neighbourCache[i];
+                break;
+            } else if ((long)(_neighbourCache[i].timestamp - entry->timestamp) < 0) {
+                entry = &_neighbourCache[i];
+            }
+        }
+
+        if (entry->state != NEIGHBOUR_STATE_EMPTY) {
+            // Drop anything still waiting for the entry being replaced
+            entry->state = NEIGHBOUR_STATE_EMPTY;
+            neighbourQueueFlush(entry);
+        }
+
+        entry->address = address;
+    }
+
+    if (mac) {
+        entry->mac = *mac;
+    }
+
+    entry->state = state;
+    entry->timestamp = millis();
+
+    if (state != NEIGHBOUR_STATE_INCOMPLETE) {
+        // Send any packets that were waiting for the address
+        neighbourQueueFlush(entry);
+    }
+
+    return entry;
+}
+
+MACAddress* EtherSia::lookupNeighbour(const IPv6Address& address)
+{
+    struct neighbour_entry *entry = neighbourCacheLookup(address);
+    if (entry == NULL || entry->state == NEIGHBOUR_STATE_INCOMPLETE) {
+        return NULL;
+    }
+
+    return &(entry->mac);
+}
+
+MACAddress* EtherSia::resolveNeighbour(IPv6Address& address, uint8_t attempts)
+{
+    struct neighbour_entry *entry = neighbourCacheLookup(address);
+
+    if (entry) {
+        if (entry->state == NEIGHBOUR_STATE_INCOMPLETE) {
+            // Discovery is already in progress
+            return NULL;
+        } else {
+            return &(entry->mac);
+        }
+    }
+
+    if (attempts == 0) {
+        return NULL;
+    }
+
+    // Copy the address, in case it is in the packet buffer
+    IPv6Address target = address;
+    entry = neighbourCacheUpdate(target, NULL, NEIGHBOUR_STATE_INCOMPLETE);
+    entry->probes = attempts;
+    neighbourSolicit(entry);
+
+    return NULL;
+}
+
+void EtherSia::neighbourSolicit(struct neighbour_entry *entry)
+{
+    // Don't overwrite a received packet that is still being handled
+    boolean switched = (_savedBuffer == NULL);
+    if (switched) {
+        selectTransmitBuffer();
+    }
+
+    // Work out the source address to send the Neighbour Solicitation from
+    if (entry->address.isLinkLocal()) {
+        icmp6SendNS(entry->address, _linkLocalAddress);
+    } else {
+        icmp6SendNS(entry->address, _globalAddress);
+    }
+
+    entry->probes--;
+    entry->timestamp = millis() + NEIGHBOUR_SOLICITATION_TIMEOUT;
+
+    if (switched) {
+        selectReceiveBuffer();
+    }
+}
+
+void EtherSia::neighbourProcessTimers()
+{
+    for (uint8_t i = 0; i < NEIGHBOUR_CACHE_SIZE; i++) {
+        struct neighbour_entry *entry = &_neighbourCache[i];
+        if (entry->state != NEIGHBOUR_STATE_INCOMPLETE ||
+                (long)(millis() - entry->timestamp) < 0) {
+            continue;
+        }
+
+        if (entry->probes) {
+            neighbourSolicit(entry);
+        } else {
+            // No response - give up
+            entry->state = NEIGHBOUR_STATE_EMPTY;
+            neighbourQueueFlush(entry);
+        }
+    }
+}
+
+uint16_t EtherSia::neighbourTimerDue(uint16_t limit)
+{
+    for (uint8_t i = 0; i < NEIGHBOUR_CACHE_SIZE; i++) {
+        struct neighbour_entry *entry = &_neighbourCache[i];
+        if (entry->state != NEIGHBOUR_STATE_INCOMPLETE) {
+            continue;
+        }
+
+        long remaining = (long)(entry->timestamp - millis());
+        if (remaining <= 0) {
+            return 0;
+        } else if (remaining < limit) {
+            limit = remaining;
+        }
+    }
+
+    return limit;
+}
+
+boolean EtherSia::neighbourQueuePacket()
+{
+#if NEIGHBOUR_QUEUE_SIZE > 0
+    IPv6Packet& packet = (IPv6Packet&)*_buffer;
+
+    for (uint8_t i = 0; i < NEIGHBOUR_QUEUE_SIZE; i++) {
+        struct neighbour_queued_packet *queued = &_neighbourQueue[i];
+        if (queued->length == 0) {
+            queued->length = packet.length();
+            memcpy(queued->frame, _buffer, queued->length);
+            return true;
+        }
+    }
+#endif
+
+    return false;
+}
+
+void EtherSia::neighbourQueueFlush(struct neighbour_entry *entry)
+{
+#if NEIGHBOUR_QUEUE_SIZE > 0
+    for (uint8_t i = 0; i < NEIGHBOUR_QUEUE_SIZE; i++) {
+        struct neighbour_queued_packet *queued = &_neighbourQueue[i];
+        IPv6Packet *packet = (IPv6Packet*)queued->frame;
+
+        if (queued->length == 0 || packet->destination() != entry->address) {
+            continue;
+        }
+
+        if (entry->state != NEIGHBOUR_STATE_EMPTY) {
+            packet->setEtherDestination(entry->mac);
+            sendFrame(queued->frame, queued->length);
+        }
+
+        queued->length = 0;
+    }
+#else
+    (void)entry;
+#endif
+}
+
+MACAddress* EtherSia::discoverNeighbour(const char* addrstr)
+{
+    IPv6Address addr(addrstr);
+    return discoverNeighbour(addr);
+}
+
+MACAddress* EtherSia::discoverNeighbour(IPv6Address& address, uint8_t attempts)
+{
+    MACAddress *mac = resolveNeighbour(address, attempts);
+
+    // Wait until the entry is resolved, or discovery has given up
+    while (mac == NULL && neighbourCacheLookup(address) != NULL) {
+        // Neighbour Advertisements are processed into the cache by receivePacket()
+        waitForPacket(NEIGHBOUR_SOLICITATION_TIMEOUT);
+        receivePacket();
+        mac = lookupNeighbour(address);
+    }
+
+    return mac;
+}
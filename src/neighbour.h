@@ -0,0 +1,55 @@
+/**
+ * Header file for the Neighbour Cache data structures
+ * @file neighbour.h
+ */
+
+#ifndef NEIGHBOUR_H
+#define NEIGHBOUR_H
+
+#include <stdint.h>
+
+#include "IPv6Address.h"
+#include "MACAddress.h"
+
+
+/**
+ * Reachability states of an entry in the Neighbour Cache
+ *
+ * A subset of the states described in RFC4861 section 7.3.2 -
+ * there is no DELAY or PROBE state, STALE entries are used as-is.
+ * @private
+ */
+enum neighbourState {
+    NEIGHBOUR_STATE_EMPTY = 0,
+    NEIGHBOUR_STATE_INCOMPLETE,
+    NEIGHBOUR_STATE_REACHABLE,
+    NEIGHBOUR_STATE_STALE
+};
+
+/**
+ * Structure for a single entry in the Neighbour Cache
+ *
+ * For INCOMPLETE entries, the timestamp is the time that the next
+ * Neighbour Solicitation is due, otherwise it is the time of the last update.
+ * @private
+ */
+struct neighbour_entry {
+    IPv6Address address;
+    MACAddress mac;
+    uint8_t state;
+    uint8_t probes;
+    unsigned long timestamp;
+};
+
+/**
+ * Structure for a packet waiting for Neighbour Discovery to complete
+ *
+ * A length of zero means that the slot is free.
+ * @private
+ */
+struct neighbour_queued_packet {
+    uint16_t length;
+    uint8_t frame[ETHERSIA_MAX_PACKET_SIZE];
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "EtherSia.h"
+#include "ring.h"
+
+
+uint8_t EtherSia::rxRingFill()
+{
+    uint8_t count = 0;
+
+#if ETHERSIA_RX_RING_SIZE > 0
+    for (uint8_t i = 0; i < ETHERSIA_RX_RING_SIZE; i++) {
+        struct rx_slot *slot = &_rxRing[i];
+        if (slot->state != RX_SLOT_FREE) {
+            continue;
+        }
+
+        _frameChecksumValid = false;
+        slot->data = lendFrame(&slot->length);
+        if (slot->data == NULL) {
+            slot->data = slot->frame;
+            slot->length = readFrame(slot->frame, sizeof(slot->frame));
+        }
+
+        if (slot->length == 0) {
+            // Nothing else waiting in the Ethernet controller
+            break;
+        }
+
+        slot->checksumValid = _frameChecksumValid;
+        slot->state = RX_SLOT_QUEUED;
+        _rxQueue[(_rxQueueHead + _rxQueueCount) % ETHERSIA_RX_RING_SIZE] = i;
+        _rxQueueCount++;
+        count++;
+    }
+#endif
+
+    return count;
+}
+
+uint16_t EtherSia::rxRingNext()
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    if (_rxQueueCount == 0) {
+        return 0;
+    }
+
+    struct rx_slot *slot = &_rxRing[_rxQueue[_rxQueueHead]];
+    _rxQueueHead = (_rxQueueHead + 1) % ETHERSIA_RX_RING_SIZE;
+    _rxQueueCount--;
+
+    slot->state = RX_SLOT_CURRENT;
+    _buffer = slot->data;
+    _frameChecksumValid = slot->checksumValid;
+    return slot->length;
+#else
+    return 0;
+#endif
+}
+
+void EtherSia::rxRingFreeSlot(struct rx_slot *slot)
+{
+    if (slot->data != slot->frame) {
+        // Give memory that was lent by the driver back to it
+        returnFrame(slot->data);
+    }
+
+    slot->data = slot->frame;
+    slot->state = RX_SLOT_FREE;
+}
+
+void EtherSia::rxRingReleaseCurrent()
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    for (uint8_t i = 0; i < ETHERSIA_RX_RING_SIZE; i++) {
+        if (_rxRing[i].state == RX_SLOT_CURRENT) {
+            rxRingFreeSlot(&_rxRing[i]);
+        }
+    }
+#endif
+
+    _buffer = _frameBuffer;
+}
+
+IPv6Packet* EtherSia::borrowPacket()
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    if (!_bufferContainsReceived) {
+        return NULL;
+    }
+
+    for (uint8_t i = 0; i < ETHERSIA_RX_RING_SIZE; i++) {
+        struct rx_slot *slot = &_rxRing[i];
+        if (slot->state == RX_SLOT_CURRENT) {
+            slot->state = RX_SLOT_BORROWED;
+
+            // Send from the spare buffer, so that the borrowed packet isn't overwritten
+            _buffer = _frameBuffer;
+            _bufferContainsReceived = false;
+
+            return (IPv6Packet*)slot->data;
+        }
+    }
+#endif
+
+    return NULL;
+}
+
+void EtherSia::releasePacket(IPv6Packet *packet)
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    for (uint8_t i = 0; i < ETHERSIA_RX_RING_SIZE; i++) {
+        struct rx_slot *slot = &_rxRing[i];
+        if (slot->state == RX_SLOT_BORROWED && (IPv6Packet*)slot->data == packet) {
+            rxRingFreeSlot(slot);
+        }
+    }
+#else
+    (void)packet;
+#endif
+}
+
+uint8_t* EtherSia::lendFrame(uint16_t *length)
+{
+    (void)length;
+    return NULL;
+}
+
+void EtherSia::returnFrame(uint8_t *frame)
+{
+    (void)frame;
+}
+
+uint8_t EtherSia::packetsWaiting()
+{
+#if ETHERSIA_RX_RING_SIZE > 0
+    return _rxQueueCount;
+#else
+    return 0;
+#endif
+}
@@ -0,0 +1,36 @@
+/**
+ * Header file for the receive ring data structures
+ * @file ring.h
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+
+/**
+ * States of a slot in the receive ring
+ * @private
+ */
+enum rxSlotState {
+    RX_SLOT_FREE = 0,
+    RX_SLOT_QUEUED,
+    RX_SLOT_CURRENT,
+    RX_SLOT_BORROWED
+};
+
+/**
+ * Structure for a single received frame in the receive ring
+ * @private
+ */
+struct rx_slot {
+    uint16_t length;
+    uint8_t state;
+    boolean checksumValid;
+    uint8_t *data;
+    uint8_t frame[ETHERSIA_MAX_PACKET_SIZE];
+};
+
+#endif
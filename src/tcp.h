@@ -8,6 +8,8 @@
 
 #include <stdint.h>
 
+#include "IPv6Address.h"
+#include "MACAddress.h"
 
 /**
  * Structure for accessing the fields of a TCP packet header
@@ -43,6 +45,100 @@ enum TCP_FLAGS {
     TCP_FLAG_FIN = 0x01   ///< No more data from sender
 };
 
+/**
+ * Enumeration for the states of a TCP connection (RFC793 section 3.2)
+ *
+ * There is no LISTEN state, because a TCPServer is always listening.
+ * @private
+ */
+enum tcpState {
+    TCP_STATE_CLOSED = 0,
+    TCP_STATE_SYN_SENT,
+    TCP_STATE_SYN_RECEIVED,
+    TCP_STATE_ESTABLISHED,
+    TCP_STATE_FIN_WAIT_1,
+    TCP_STATE_FIN_WAIT_2,
+    TCP_STATE_CLOSE_WAIT,
+    TCP_STATE_CLOSING,
+    TCP_STATE_LAST_ACK,
+    TCP_STATE_TIME_WAIT
+};
+
+/**
+ * Structure for a Transmission Control Block - the state of one TCP connection
+ *
+ * A state of TCP_STATE_CLOSED means that the entry is free.
+ * @private
+ */
+struct tcp_connection {
+    IPv6Address remoteAddress;
+    MACAddress remoteMac;
+    uint16_t remotePort;
+    uint8_t state;
+    uint16_t mss;                  ///< The largest segment that the remote end can receive
+    uint16_t sendWindow;           ///< SND.WND - the window advertised by the remote end
+    uint32_t sendUnacknowledged;   ///< SND.UNA - the oldest sequence number not yet acknowledged
+    uint32_t sendNext;             ///< SND.NXT - the next sequence number to be sent
+    uint32_t sendMax;              ///< SND.MAX - the highest sequence number sent so far
+    uint32_t receiveNext;          ///< RCV.NXT - the next sequence number expected
+    unsigned long lastActivity;    ///< The time that a segment was last received
+
+    uint32_t responseStart;        ///< The sequence number of the first byte of the response
+    uint8_t responseId;            ///< Passed to rewriteResponse(), to identify the response
+
+    unsigned long sendTime;        ///< The time that the oldest unacknowledged segment was sent
+    uint8_t retransmissions;       ///< The number of times it has been re-sent
+    uint16_t rto;                  ///< The retransmission timeout (in milliseconds)
+    uint16_t srtt;                 ///< The smoothed round-trip time (in milliseconds)
+    uint16_t rttvar;               ///< The round-trip time variation (in milliseconds)
+    boolean rttTiming;             ///< true if a segment is being timed
+    uint32_t rttSequence;          ///< The acknowledgement number that ends the timing
+    unsigned long rttStart;        ///< The time that the segment being timed was sent
+};
+
+/**
+ * The Maximum Segment Size to assume, if the remote end doesn't send the option
+ * (the IPv6 minimum MTU of 1280, less the IPv6 and TCP headers)
+ * @private
+ */
+#define TCP_DEFAULT_MSS           (1220)
+
+/** The retransmission timeout (in milliseconds) before the round-trip time has been measured (RFC6298) */
+#define TCP_INITIAL_RTO          (1000)
+
+/** The shortest retransmission timeout (in milliseconds) */
+#define TCP_MIN_RTO              (200)
+
+/** The longest retransmission timeout (in milliseconds) */
+#define TCP_MAX_RTO              (60000)
+
+/** How many times to re-send a segment, before resetting the connection */
+#define TCP_MAX_RETRANSMISSIONS  (6)
+
+/**
+ * How long (in milliseconds) to wait for the next segment of data,
+ * in TCPServer::receiveMore() and TCPClient::receive(), before giving up
+ */
+#define TCP_RECEIVE_TIMEOUT      (10000)
+
+/**
+ * How long (in milliseconds) to wait for the other end to acknowledge
+ * enough data to send the next segment, before giving up
+ */
+#define TCP_SEND_TIMEOUT         (10000)
+
+/**
+ * Check if one TCP sequence number comes before another, allowing for wrap-around
+ * @private
+ */
+#define TCP_SEQ_LT(a, b)          ((int32_t)((uint32_t)(a) - (uint32_t)(b)) < 0)
+
+/**
+ * Check if one TCP sequence number comes before or is the same as another
+ * @private
+ */
+#define TCP_SEQ_LE(a, b)          ((int32_t)((uint32_t)(a) - (uint32_t)(b)) <= 0)
+
 /**
  * The minimum length of a TCP response packet without any extra options
  * @private
@@ -106,6 +106,8 @@ void printHexDump(const uint8_t bytes[], uint16_t len, Print &p)
     }
 }
 
+#ifdef __AVR__
+
 // This function comes from Contiki's uip6.c
 uint16_t chksum(uint16_t sum, const uint8_t *data, uint16_t len)
 {
@@ -136,3 +138,75 @@ uint16_t chksum(uint16_t sum, const uint8_t *data, uint16_t len)
     /* Return sum in host byte order. */
     return sum;
 }
+
+#else
+
+#if UINTPTR_MAX > 0xFFFFFFFFUL
+/* 64-bit CPU: add 32-bit words into a 64-bit accumulator */
+typedef uint64_t chksum_acc_t;
+typedef uint32_t chksum_word_t;
+#else
+/* 32-bit CPU: add 16-bit words into a 32-bit accumulator */
+typedef uint32_t chksum_acc_t;
+typedef uint16_t chksum_word_t;
+#endif
+
+static inline chksum_acc_t chksum_load(const uint8_t *ptr)
+{
+    chksum_word_t word;
+    memcpy(&word, ptr, sizeof(word));
+    return word;
+}
+
+// Word-at-a-time version of the function above, as described in RFC1071.
+// The data is summed in native byte order, with the carries collected in
+// the top of the accumulator, and then folded down to 16-bits. The
+// length is at most 64k, so the accumulator can never overflow.
+uint16_t chksum(uint16_t sum, const uint8_t *data, uint16_t len)
+{
+    chksum_acc_t acc = 0;
+
+    while (len >= 4 * sizeof(chksum_word_t)) {
+        acc += chksum_load(data);
+        acc += chksum_load(data + sizeof(chksum_word_t));
+        acc += chksum_load(data + 2 * sizeof(chksum_word_t));
+        acc += chksum_load(data + 3 * sizeof(chksum_word_t));
+        data += 4 * sizeof(chksum_word_t);
+        len -= 4 * sizeof(chksum_word_t);
+    }
+
+    while (len >= 2) {
+        uint16_t word;
+        memcpy(&word, data, sizeof(word));
+        acc += word;
+        data += 2;
+        len -= 2;
+    }
+
+    if (len) {
+        /* Pad the last byte with zero */
+        uint8_t last[2] = { data[0], 0 };
+        uint16_t word;
+        memcpy(&word, last, sizeof(word));
+        acc += word;
+    }
+
+    while (acc >> 16) {
+        acc = (acc & 0xFFFF) + (acc >> 16);
+    }
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    uint32_t result = acc;
+#else
+    /* Summing in little-endian order gives a byte-swapped result */
+    uint32_t result = ((acc & 0xFF) << 8) | (acc >> 8);
+#endif
+
+    /* Add on the sum passed in, in host byte order */
+    result += sum;
+    result = (result & 0xFFFF) + (result >> 16);
+
+    return result;
+}
+
+#endif
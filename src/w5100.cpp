@@ -208,6 +208,7 @@ void EtherSia_W5100::wizchip_sw_reset()
 EtherSia_W5100::EtherSia_W5100(int8_t cs)
 {
     _cs = cs;
+    _rxOverruns = 0;
 }
 
 boolean EtherSia_W5100::begin(const MACAddress &address)
@@ -221,7 +222,8 @@ boolean EtherSia_W5100::begin(const MACAddress &address)
 
     wizchip_sw_reset();
 
-    // Set the size of the Rx and Tx buffers
+    // Set the size of the Rx and Tx buffers for socket 0 (all 8kB by default)
+    // Memory is allocated to sockets in order, so the other sockets get what is left
     wizchip_write(RMSR, RxBufferSize);
     wizchip_write(TMSR, TxBufferSize);
 
@@ -254,7 +256,14 @@ uint16_t EtherSia_W5100::readFrame(uint8_t *buffer, uint16_t bufsize)
 {
     uint16_t len = getSn_RX_RSR();
 
-    if (len > 0)
+    // Not enough room left for another full-sized frame?
+    // (1kB can never hold one, so there is nothing to check)
+    if (RxBufferLength > MaxFrameLength && len > RxBufferLength - MaxFrameLength) {
+        _rxOverruns++;
+    }
+
+    // Keep going until we find a frame we want, or run out of frames
+    for (; len > 0; len = getSn_RX_RSR())
     {
         uint8_t head[2];
         uint16_t data_len=0;
@@ -271,10 +280,27 @@ uint16_t EtherSia_W5100::readFrame(uint8_t *buffer, uint16_t bufsize)
             // Packet is bigger than buffer - drop the packet
             wizchip_recv_ignore(data_len);
             setSn_CR(Sn_CR_RECV);
-            return 0;
+            continue;
         }
 
-        wizchip_recv_data(buffer, data_len);
+        if (data_len > sizeof(IPv6Packet))
+        {
+            // Read just the headers first, so that we don't copy
+            // frames that aren't for us over SPI
+            wizchip_recv_data(buffer, sizeof(IPv6Packet));
+            if (!filterPacket((IPv6Packet&)*buffer))
+            {
+                wizchip_recv_ignore(data_len - sizeof(IPv6Packet));
+                setSn_CR(Sn_CR_RECV);
+                continue;
+            }
+
+            wizchip_recv_data(buffer + sizeof(IPv6Packet), data_len - sizeof(IPv6Packet));
+        }
+        else
+        {
+            wizchip_recv_data(buffer, data_len);
+        }
         setSn_CR(Sn_CR_RECV);
 
         return data_len;
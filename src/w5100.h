@@ -42,6 +42,26 @@
 
 #include "EtherSia.h"
 
+#ifndef W5100_RX_BUFFER_SIZE
+/**
+ * Size (in kB) of the W5100 receive memory to give to socket 0
+ *
+ * The W5100 has 8kB of receive memory, which is allocated to the sockets
+ * in order. EtherSia only uses socket 0 (in MACRAW mode), so by default
+ * it gets all of it. Must be 1, 2, 4 or 8.
+ */
+#define W5100_RX_BUFFER_SIZE    (8)
+#endif
+
+#ifndef W5100_TX_BUFFER_SIZE
+/**
+ * Size (in kB) of the W5100 transmit memory to give to socket 0
+ *
+ * Must be 1, 2, 4 or 8.
+ */
+#define W5100_TX_BUFFER_SIZE    (8)
+#endif
+
 /**
  * Send and receive Ethernet frames directly using a Wiznet W5100 controller.
  */
@@ -88,19 +108,42 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
 
+    /**
+     * Get the number of times that the receive memory was found to be full
+     *
+     * The W5100 silently drops frames when there isn't room for them in its
+     * receive memory, so this counts the times that readFrame() found less
+     * than a full-sized frame of space free. If it keeps going up,
+     * frames are probably being lost.
+     *
+     * @note Always 0 if W5100_RX_BUFFER_SIZE is 1, which is too small
+     *       for a full-sized frame.
+     *
+     * @return The number of times the receive memory was full
+     */
+    inline uint16_t rxOverruns() {
+        return _rxOverruns;
+    }
+
 private:
     static const uint16_t TxBufferAddress = 0x4000;  /* Internal Tx buffer address of the iinchip */
     static const uint16_t RxBufferAddress = 0x6000;  /* Internal Rx buffer address of the iinchip */
-    static const uint8_t TxBufferSize = 0x3; /* Buffer size configuration: 0=1kb, 1=2kB, 2=4kB, 3=8kB */
-    static const uint8_t RxBufferSize = 0x3; /* Buffer size configuration: 0=1kb, 1=2kB, 2=4kB, 3=8kB */
+    static const uint8_t TxBufferSize = /* Buffer size configuration: 0=1kb, 1=2kB, 2=4kB, 3=8kB */
+        (W5100_TX_BUFFER_SIZE >= 8) ? 0x3 : (W5100_TX_BUFFER_SIZE >= 4) ? 0x2 : (W5100_TX_BUFFER_SIZE >= 2) ? 0x1 : 0x0;
+    static const uint8_t RxBufferSize = /* Buffer size configuration: 0=1kb, 1=2kB, 2=4kB, 3=8kB */
+        (W5100_RX_BUFFER_SIZE >= 8) ? 0x3 : (W5100_RX_BUFFER_SIZE >= 4) ? 0x2 : (W5100_RX_BUFFER_SIZE >= 2) ? 0x1 : 0x0;
     static const uint16_t TxBufferLength = (1 << TxBufferSize) << 10; /* Length of Tx buffer in bytes */
     static const uint16_t RxBufferLength = (1 << RxBufferSize) << 10; /* Length of Rx buffer in bytes */
     static const uint16_t TxBufferMask = TxBufferLength - 1;
     static const uint16_t RxBufferMask = RxBufferLength - 1;
+    static const uint16_t MaxFrameLength = 1514 + 2; /* Largest Ethernet frame (without FCS), plus the MACRAW header */
 
 
     int8_t _cs;
 
+    /** Number of times the receive memory was found to be full */
+    uint16_t _rxOverruns;
+
     /**
      * Default function to select chip.
      * @note This function help not to access wrong address. If you do not describe this function or register any functions,
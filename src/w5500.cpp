@@ -61,8 +61,6 @@ uint16_t EtherSia_W5500::wizchip_read_word(uint8_t block, uint16_t address)
 
 void EtherSia_W5500::wizchip_read_buf(uint8_t block, uint16_t address, uint8_t* pBuf, uint16_t len)
 {
-    uint16_t i;
-
     wizchip_cs_select();
 
     block |= AccessModeRead;
@@ -70,8 +68,7 @@ void EtherSia_W5500::wizchip_read_buf(uint8_t block, uint16_t address, uint8_t*
     wizchip_spi_write_byte((address & 0xFF00) >> 8);
     wizchip_spi_write_byte((address & 0x00FF) >> 0);
     wizchip_spi_write_byte(block);
-    for(i = 0; i < len; i++)
-        pBuf[i] = wizchip_spi_read_byte();
+    wizchip_spi_read_burst(pBuf, len);
 
     wizchip_cs_deselect();
 }
@@ -98,8 +95,6 @@ void EtherSia_W5500::wizchip_write_word(uint8_t block, uint16_t address, uint16_
 
 void EtherSia_W5500::wizchip_write_buf(uint8_t block, uint16_t address, const uint8_t* pBuf, uint16_t len)
 {
-    uint16_t i;
-
     wizchip_cs_select();
 
     block |= AccessModeWrite;
@@ -107,12 +102,32 @@ void EtherSia_W5500::wizchip_write_buf(uint8_t block, uint16_t address, const ui
     wizchip_spi_write_byte((address & 0xFF00) >> 8);
     wizchip_spi_write_byte((address & 0x00FF) >> 0);
     wizchip_spi_write_byte(block);
-    for(i = 0; i < len; i++)
-        wizchip_spi_write_byte(pBuf[i]);
+    wizchip_spi_write_burst(pBuf, len);
 
     wizchip_cs_deselect();
 }
 
+void EtherSia_W5500::wizchip_spi_read_burst(uint8_t *buf, uint16_t len)
+{
+    // The bytes sent while reading are ignored by the W5500
+    SPI.transfer(buf, len);
+}
+
+void EtherSia_W5500::wizchip_spi_write_burst(const uint8_t *buf, uint16_t len)
+{
+    // SPI.transfer() overwrites the buffer with the bytes received,
+    // so copy the data through a small buffer on the stack
+    uint8_t chunk[32];
+
+    while (len > 0) {
+        uint16_t n = len < sizeof(chunk) ? len : sizeof(chunk);
+        memcpy(chunk, buf, n);
+        SPI.transfer(chunk, n);
+        buf += n;
+        len -= n;
+    }
+}
+
 void EtherSia_W5500::setSn_CR(uint8_t cr) {
     // Write the command to the Command Register
     wizchip_write(BlockSelectSReg, Sn_CR, cr);
@@ -247,9 +262,20 @@ int8_t EtherSia_W5500::wizphy_setphypmode(uint8_t pmode)
 }
 
 
+volatile boolean EtherSia_W5500::_interruptPending = false;
+
+void EtherSia_W5500::interruptHandler()
+{
+    _interruptPending = true;
+}
+
 EtherSia_W5500::EtherSia_W5500(int8_t cs)
 {
     _cs = cs;
+    _intPin = -1;
+    _asyncSend = false;
+    _sendPending = false;
+    _rxOverruns = 0;
 }
 
 boolean EtherSia_W5500::begin(const MACAddress &address)
@@ -263,9 +289,17 @@ boolean EtherSia_W5500::begin(const MACAddress &address)
 
     wizchip_sw_reset();
 
-    // Use the full 16Kb of RAM for Socket 0
-    setSn_RXBUF_SIZE(16);
-    setSn_TXBUF_SIZE(16);
+    // Only socket 0 is used, so take the buffer memory away from the others.
+    // The total for all 8 sockets must not be more than 16kB.
+    for (uint8_t sn = 1; sn < 8; sn++) {
+        uint8_t block = (4 * sn + 1) << 3;
+        wizchip_write(block, Sn_RXBUF_SIZE, 0);
+        wizchip_write(block, Sn_TXBUF_SIZE, 0);
+    }
+
+    // Give Socket 0 the buffer memory (all 16kB by default)
+    setSn_RXBUF_SIZE(W5500_RX_BUFFER_SIZE);
+    setSn_TXBUF_SIZE(W5500_TX_BUFFER_SIZE);
 
     // Set our local MAC address
     setSHAR(_mac_address);
@@ -278,11 +312,28 @@ boolean EtherSia_W5500::begin(const MACAddress &address)
         return false;
     }
 
+    if (_intPin >= 0) {
+        // Assert INTn when socket 0 receives data
+        setSn_IMR(Sn_IR_RECV);
+        wizchip_write(BlockSelectCReg, SIMR, 0x01);
+
+        pinMode(_intPin, INPUT);
+        _interruptPending = true;
+        attachInterrupt(digitalPinToInterrupt(_intPin), interruptHandler, FALLING);
+    }
+
     return EtherSia::begin();
 }
 
 void EtherSia_W5500::end()
 {
+    // Let the last frame finish sending
+    waitSendComplete();
+
+    if (_intPin >= 0) {
+        detachInterrupt(digitalPinToInterrupt(_intPin));
+    }
+
     setSn_CR(Sn_CR_CLOSE);
 
     // clear all interrupt of the socket
@@ -294,9 +345,28 @@ void EtherSia_W5500::end()
 
 uint16_t EtherSia_W5500::readFrame(uint8_t *buffer, uint16_t bufsize)
 {
+    if (_intPin >= 0) {
+        if (!_interruptPending) {
+            // INTn hasn't signalled - don't touch the SPI bus
+            return 0;
+        }
+
+        // Clear the flag and interrupt before checking, so a frame arriving now isn't missed
+        _interruptPending = false;
+        setSn_IR(Sn_IR_RECV);
+    }
+
     uint16_t len = getSn_RX_RSR();
 
-    if (len > 0)
+    // Not enough room left for another full-sized frame?
+    // (1kB can never hold one, so there is nothing to check)
+    if ((W5500_RX_BUFFER_SIZE << 10) > MaxFrameLength &&
+            len > (W5500_RX_BUFFER_SIZE << 10) - MaxFrameLength) {
+        _rxOverruns++;
+    }
+
+    // Keep going until we find a frame we want, or run out of frames
+    for (; len > 0; len = getSn_RX_RSR())
     {
         uint8_t head[2];
         uint16_t data_len=0;
@@ -313,12 +383,34 @@ uint16_t EtherSia_W5500::readFrame(uint8_t *buffer, uint16_t bufsize)
             // Packet is bigger than buffer - drop the packet
             wizchip_recv_ignore(data_len);
             setSn_CR(Sn_CR_RECV);
-            return 0;
+            continue;
         }
 
-        wizchip_recv_data(buffer, data_len);
+        if (data_len > sizeof(IPv6Packet))
+        {
+            // Read just the headers first, so that we don't copy
+            // frames that aren't for us over SPI
+            wizchip_recv_data(buffer, sizeof(IPv6Packet));
+            if (!filterPacket((IPv6Packet&)*buffer))
+            {
+                wizchip_recv_ignore(data_len - sizeof(IPv6Packet));
+                setSn_CR(Sn_CR_RECV);
+                continue;
+            }
+
+            wizchip_recv_data(buffer + sizeof(IPv6Packet), data_len - sizeof(IPv6Packet));
+        }
+        else
+        {
+            wizchip_recv_data(buffer, data_len);
+        }
         setSn_CR(Sn_CR_RECV);
 
+        if (_intPin >= 0) {
+            // There may be more frames waiting - check again next time
+            _interruptPending = true;
+        }
+
         return data_len;
     }
 
@@ -337,27 +429,57 @@ uint16_t EtherSia_W5500::sendFrame(const uint8_t *buf, uint16_t len)
         if (len <= freesize) break;
     };
 
+    // The frame can be copied in while the previous one is still being sent
     wizchip_send_data(buf, len);
+
+    // But only one SEND command can be in progress at a time
+    waitSendComplete();
+
     setSn_CR(Sn_CR_SEND);
+    _sendPending = true;
 
-    while(1)
+    if (!_asyncSend && !waitSendComplete()) {
+        // There was a timeout
+        return -1;
+    }
+
+    return len;
+}
+
+boolean EtherSia_W5500::sendComplete()
+{
+    if (_sendPending) {
+        uint8_t tmp = getSn_IR() & (Sn_IR_SENDOK | Sn_IR_TIMEOUT);
+        if (tmp) {
+            setSn_IR(tmp);
+            _sendPending = false;
+        }
+    }
+
+    return !_sendPending;
+}
+
+boolean EtherSia_W5500::waitSendComplete()
+{
+    while(_sendPending)
     {
         uint8_t tmp = getSn_IR();
         if (tmp & Sn_IR_SENDOK)
         {
             setSn_IR(Sn_IR_SENDOK);
             // Packet sent ok
-            break;
+            _sendPending = false;
         }
         else if (tmp & Sn_IR_TIMEOUT)
         {
             setSn_IR(Sn_IR_TIMEOUT);
             // There was a timeout
-            return -1;
+            _sendPending = false;
+            return false;
         }
     }
 
-    return len;
+    return true;
 }
 
 void EtherSia_W5500::wizchip_cs_select()
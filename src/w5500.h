@@ -42,6 +42,26 @@
 
 #include "EtherSia.h"
 
+#ifndef W5500_RX_BUFFER_SIZE
+/**
+ * Size (in kB) of the W5500 receive memory to give to socket 0
+ *
+ * The W5500 has 16kB of receive memory shared between its 8 sockets.
+ * EtherSia only uses socket 0 (in MACRAW mode), so by default it gets all
+ * of it and the other sockets get none. Must be 1, 2, 4, 8 or 16.
+ */
+#define W5500_RX_BUFFER_SIZE    (16)
+#endif
+
+#ifndef W5500_TX_BUFFER_SIZE
+/**
+ * Size (in kB) of the W5500 transmit memory to give to socket 0
+ *
+ * Must be 1, 2, 4, 8 or 16.
+ */
+#define W5500_TX_BUFFER_SIZE    (16)
+#endif
+
 /**
  * Send and receive Ethernet frames directly using a Wiznet W5500 controller.
  */
@@ -88,6 +108,86 @@ public:
      */
     virtual uint16_t readFrame(uint8_t *buffer, uint16_t bufsize);
 
+    /**
+     * Make sendFrame() return as soon as the frame has been handed to the W5500
+     *
+     * The W5500 then transmits the frame while the next packet is being
+     * built. sendFrame() only waits for the previous frame to finish just
+     * before the next one is sent. Transmit timeouts are not reported in this mode.
+     */
+    inline void enableAsyncSend() {
+        _asyncSend = true;
+    }
+
+    /**
+     * Make sendFrame() wait until each frame has been transmitted (the default)
+     */
+    inline void disableAsyncSend() {
+        _asyncSend = false;
+    }
+
+    /**
+     * Check if the last frame passed to sendFrame() has finished transmitting
+     *
+     * @return true if there is no frame waiting to be transmitted
+     */
+    boolean sendComplete();
+
+    /**
+     * Get the number of times that the receive memory was found to be full
+     *
+     * The W5500 silently drops frames when there isn't room for them in its
+     * receive memory, so this counts the times that readFrame() found less
+     * than a full-sized frame of space free. If it keeps going up,
+     * frames are probably being lost.
+     *
+     * @note Always 0 if W5500_RX_BUFFER_SIZE is 1, which is too small
+     *       for a full-sized frame.
+     *
+     * @return The number of times the receive memory was full
+     */
+    inline uint16_t rxOverruns() {
+        return _rxOverruns;
+    }
+
+    /**
+     * Use the W5500's INTn pin to find out when frames have arrived
+     *
+     * Call this before begin(). readFrame() then returns straight away,
+     * without any SPI traffic, until the INTn pin signals that a frame is waiting.
+     *
+     * @note Only one W5500 can use its interrupt pin at a time
+     * @param pin The Arduino pin that INTn is connected to (must support attachInterrupt())
+     */
+    inline void setInterruptPin(int8_t pin) {
+        _intPin = pin;
+    }
+
+protected:
+
+    /**
+     * Read a block of bytes over SPI, while the chip is selected
+     *
+     * This is used to copy frames out of the W5500 and uses SPI.transfer(buf, len),
+     * which is much quicker than transferring a byte at a time.
+     * Override it in a subclass to use DMA on platforms that support it.
+     *
+     * @param buf Pointer to the buffer to read into
+     * @param len Number of bytes to read
+     */
+    virtual void wizchip_spi_read_burst(uint8_t *buf, uint16_t len);
+
+    /**
+     * Write a block of bytes over SPI, while the chip is selected
+     *
+     * This is used to copy frames into the W5500.
+     * Override it in a subclass to use DMA on platforms that support it.
+     *
+     * @param buf Pointer to the data to write
+     * @param len Number of bytes to write
+     */
+    virtual void wizchip_spi_write_burst(const uint8_t *buf, uint16_t len);
+
 private:
 
     //< SPI interface Read operation in Control Phase
@@ -108,11 +208,38 @@ private:
     //< Socket 0 Rx buffer address block
     static const uint8_t BlockSelectRxBuf = (0x03 << 3);
 
+    //< Largest Ethernet frame (without FCS), plus the 2 byte MACRAW length header
+    static const uint16_t MaxFrameLength = 1514 + 2;
+
 
 
     int8_t _cs;
     uint8_t _mac_address[6];
 
+    /** Flag indicating if sendFrame() returns without waiting for the frame to be sent */
+    boolean _asyncSend;
+
+    /** Flag indicating if a SEND command has been issued but not completed yet */
+    boolean _sendPending;
+
+    /** Number of times the receive memory was found to be full */
+    uint16_t _rxOverruns;
+
+    /** The pin connected to INTn, or -1 to poll Sn_RX_RSR */
+    int8_t _intPin;
+
+    /** Flag set by the interrupt handler when the INTn pin has signalled */
+    static volatile boolean _interruptPending;
+
+    /** Interrupt handler for the INTn pin */
+    static void interruptHandler();
+
+    /**
+     * Wait for the SEND command in progress (if any) to complete
+     * @return false if the frame timed out
+     */
+    boolean waitSendComplete();
+
     /**
      * Default function to select chip.
      * @note This function help not to access wrong address. If you do not describe this function or register any functions,
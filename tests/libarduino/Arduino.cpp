@@ -1,6 +1,10 @@
 #include "Arduino.h"
 
-uint32_t millis( void ) {return 0;}
+static uint32_t currentMillis = 0;
+static long currentRandom = 0x55555555;
+
+uint32_t millis( void ) {return currentMillis;}
+void setMillis(uint32_t msec) {currentMillis = msec;}
 uint32_t micros( void ) {return 100;}
 void delay(uint32_t /* msec */) {}
 void delayMicroseconds(uint32_t /* us */) {}
@@ -8,8 +12,11 @@ void delayMicroseconds(uint32_t /* us */) {}
 void pinMode(uint8_t, uint8_t) {}
 void digitalWrite(uint8_t, uint8_t) {}
 int digitalRead(uint8_t) {return 0;}
+void attachInterrupt(uint8_t, void (*)(void), int) {}
+void detachInterrupt(uint8_t) {}
 
-long random() {return 0x55555555;}
+long random() {return currentRandom;}
+void setRandom(long value) {currentRandom = value;}
 long random(long max) {return max/2;}
 long random(long min, long max) {return ((max-min)/2)+min;}
 void randomSeed(unsigned long) {}
@@ -12,6 +12,10 @@
 #define OUTPUT 0x1
 #define INPUT_PULLUP 0x2
 
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
 extern "C" {
     typedef uint16_t word;
     typedef uint8_t byte ;
@@ -27,6 +31,7 @@ extern void loop( void ) ;
 
 uint32_t millis( void );
 uint32_t micros( void );
+void setMillis(uint32_t msec);  /* for testing: set the value returned by millis() */
 void delay(uint32_t msec);
 void delayMicroseconds(uint32_t us);
 
@@ -34,7 +39,12 @@ void pinMode(uint8_t, uint8_t);
 void digitalWrite(uint8_t, uint8_t);
 int digitalRead(uint8_t);
 
+#define digitalPinToInterrupt(p) (p)
+void attachInterrupt(uint8_t, void (*)(void), int mode);
+void detachInterrupt(uint8_t);
+
 long random();
+void setRandom(long value);  /* for testing: set the value returned by random() */
 long random(long);
 long random(long, long);
 void randomSeed(unsigned long);
@@ -1,6 +1,8 @@
 #ifndef Progmem_h
 #define Progmem_h
 
+#include <strings.h>
+
 class __FlashStringHelper;
 
 #define PROGMEM
@@ -13,6 +15,7 @@ class __FlashStringHelper;
 #define strcpy_P(dst, src) strcpy(dst, src)
 #define strncpy_P(dst, src, len) strncpy(dst, src, len)
 #define strlen_P(str) strlen(str)
+#define strncasecmp_P(s1, s2, n) strncasecmp(s1, s2, n)
 #define pgm_read_byte(addr) *(addr)
 
 #endif
@@ -3,6 +3,7 @@
 void SPIClass::begin() {}
 
 uint8_t SPIClass::transfer(uint8_t val) { return val; }
+void SPIClass::transfer(void * /*buf*/, size_t /*count*/) {}
 
 void SPIClass::end() {}
 
@@ -1,4 +1,5 @@
 #include <stdint.h>
+#include <stddef.h>
 
 #ifndef ARDUINO_SPI
 #define ARDUINO_SPI 1
@@ -43,6 +44,7 @@ public:
   static void begin();
 
   static uint8_t transfer(uint8_t val);
+  static void transfer(void *buf, size_t count);
 
   static void end();
 